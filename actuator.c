@@ -0,0 +1,622 @@
+/**
+ * @file actuator.c
+ * @note Copyright (C) 2022 SyncMonk Technologies <services@syncmonk.net>
+ * @note SPDX-License-Identifier: GPL-2.0+
+ */
+
+#define _GNU_SOURCE
+#include <linux/futex.h>
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "actuator.h"
+#include "clockadj.h"
+#include "logger.h"
+#include "metrics.h"
+#include "probes.h"
+#include "seqlock.h"
+#include "trace.h"
+#include "utils.h"
+/******************************************************************************
+ * Local Definitions
+ *****************************************************************************/
+/* Clocks with a cached state, the frequency and the time of day clock. */
+#define ACTUATOR_CLOCKS 4
+
+/* Longer delays come from a step or a clock in another time scale. */
+#define ACTUATOR_MAX_DELAY_NS 1000000000LL
+
+/* Weight of a new delay in its moving average, 1/N. */
+#define ACTUATOR_DELAY_SMOOTH 8
+
+enum actuator_op
+{
+    ACTUATOR_SET_FREQ,
+    ACTUATOR_STEP,
+    ACTUATOR_SET_PHASE,
+    ACTUATOR_JUMP,
+    ACTUATOR_STOP,
+};
+
+struct actuator_cmd
+{
+    enum actuator_op op;
+    /* Clock of the frequency and phase, time of day clock of a step. */
+    clockid_t clkid;
+    /* Time of day clock of a jump. */
+    clockid_t tod_clkid;
+    double freq;
+    int64_t ns;
+    /* CLOCK_MONOTONIC time the command was posted [ns]. */
+    uint64_t posted_ns;
+    /* Time stamp of the sample behind a frequency, 0 if not measured. */
+    uint64_t sample_ts;
+};
+
+/* Last frequency word written to a clock, owned by the applying thread. */
+struct clock_cache
+{
+    clockid_t clkid;
+    int used;
+    int valid;
+    long freq_word;
+    /* Frequency step of a dithered clock [ppb], 0 without dithering. */
+    double resolution;
+    /* Quantization error carried to the next write [ppb]. */
+    double residue;
+};
+
+/* Producer and consumer indices on their own cache lines. */
+static struct
+{
+    uint32_t head __attribute__((aligned(64)));
+    uint32_t waiting;
+    uint32_t tail __attribute__((aligned(64)));
+    struct actuator_cmd cmds[ACTUATOR_QUEUE_LEN] __attribute__((aligned(64)));
+} queue;
+
+/* A device following the frequency clock, applied by its own thread. */
+struct follower
+{
+    /* Seqlock of the posted frequency. */
+    uint64_t seq __attribute__((aligned(64)));
+    double freq;
+    uint64_t posted_ns;
+    /* Futex word, advanced after every posting. */
+    uint32_t wake;
+    uint32_t waiting;
+    uint32_t stop;
+    /* Owned by the follower thread. */
+    struct clock_cache cache __attribute__((aligned(64)));
+    pthread_t thread;
+    struct actuator_follower_stats stats;
+};
+
+static struct clock_cache cache[ACTUATOR_CLOCKS];
+static struct follower followers[ACTUATOR_MAX_FOLLOWERS];
+static int n_followers;
+static pthread_t actuator_thread;
+static int started;
+
+/* Clock read around the frequency writes, the time scale of the samples. */
+static clockid_t delay_clkid;
+static int delay_measured;
+/* Time stamp of the sample for the next frequency, producer side. */
+static uint64_t next_sample_ts;
+/* Moving average of the actuation delay [ns]. */
+static int64_t delay_avg;
+
+/******************************************************************************
+ * Local Functions
+ *****************************************************************************/
+static inline uint64_t
+now_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline uint64_t
+clock_ns(clockid_t clkid)
+{
+    struct timespec ts;
+
+    clock_gettime(clkid, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static struct clock_cache*
+cache_get(clockid_t clkid)
+{
+    int i;
+
+    for (i = 0; i < ACTUATOR_CLOCKS; i++) {
+        if (!cache[i].used) {
+            cache[i].used = 1;
+            cache[i].clkid = clkid;
+            return &cache[i];
+        }
+        if (cache[i].clkid == clkid) {
+            return &cache[i];
+        }
+    }
+    /* Uncached, every write goes to the clock. */
+    return NULL;
+}
+
+/*
+ * First order sigma-delta: quantize the frequency plus the error left by
+ * the previous write, so the average over a few writes is the requested
+ * frequency even if each write is a multiple of the resolution.
+ */
+static double
+dither(struct clock_cache* cc, double freq)
+{
+    double target, out;
+
+    if (!cc || cc->resolution <= 0.0) {
+        return freq;
+    }
+    target = freq + cc->residue;
+    out = round(target / cc->resolution) * cc->resolution;
+    cc->residue = target - out;
+    /* Aim at the middle of the kernel word, which truncates toward zero. */
+    return out + copysign(0.5 / 65.536, out);
+}
+
+/* A frequency not written because the clock already runs with its word. */
+static void
+keep_freq(clockid_t clkid, double freq)
+{
+    trace_debug("%s freq: %f", __func__, freq);
+    PROBE2(keep_freq, clkid, (int64_t)(freq * 1e3));
+}
+
+/*
+ * Set the frequency unless the clock already runs with the same frequency
+ * word, in which case the write would not change the hardware. Returns
+ * whether the clock was written.
+ */
+static int
+set_freq(struct metrics_counters* c, struct clock_cache* cc, clockid_t clkid, double freq)
+{
+    long word;
+
+    freq = dither(cc, freq);
+    word = clockadj_freq_word(freq);
+    if (cc && cc->valid && cc->freq_word == word) {
+        c->actuations_skipped++;
+        keep_freq(clkid, freq);
+        return 0;
+    }
+    c->actuations++;
+    if (cc) {
+        cc->valid = !clockadj_set_freq(clkid, freq);
+        cc->freq_word = word;
+    } else {
+        clockadj_set_freq(clkid, freq);
+    }
+    return 1;
+}
+
+/*
+ * Set the frequency between two readings of the clock of the samples, it
+ * took effect at about their midpoint.
+ */
+static void
+set_freq_measured(struct metrics_counters* c, const struct actuator_cmd* cmd)
+{
+    uint64_t before, after;
+    int64_t delay, avg;
+
+    before = clock_ns(delay_clkid);
+    if (!set_freq(c, cache_get(cmd->clkid), cmd->clkid, cmd->freq)) {
+        /* Nothing took effect, no driver time to account. */
+        return;
+    }
+    after = clock_ns(delay_clkid);
+
+    delay = before + (after - before) / 2 - cmd->sample_ts;
+    if (delay <= 0 || delay >= ACTUATOR_MAX_DELAY_NS) {
+        return;
+    }
+    avg = __atomic_load_n(&delay_avg, __ATOMIC_RELAXED);
+    avg = avg ? avg + (delay - avg) / ACTUATOR_DELAY_SMOOTH : delay;
+    __atomic_store_n(&delay_avg, avg, __ATOMIC_RELAXED);
+    trace_debug("actuation took effect %" PRId64 " ns after the sample, average %" PRId64 " ns", delay, avg);
+}
+
+static void
+jump(struct metrics_counters* c, const struct actuator_cmd* cmd)
+{
+    struct clock_cache* cc = cache_get(cmd->clkid);
+    double freq;
+
+    /* The servo starts over, so does the dithering. */
+    if (cc) {
+        cc->residue = 0.0;
+    }
+    /* A PHC takes either ADJ_SETOFFSET or ADJ_FREQUENCY per call. */
+    if (cmd->clkid != CLOCK_REALTIME || cmd->tod_clkid != CLOCK_REALTIME) {
+        set_freq(c, cc, cmd->clkid, cmd->freq);
+        c->actuations++;
+        clockadj_step(cmd->tod_clkid, cmd->ns);
+        return;
+    }
+    freq = dither(cc, cmd->freq);
+    if (cc && cc->valid && cc->freq_word == clockadj_freq_word(freq)) {
+        c->actuations_skipped++;
+        keep_freq(cmd->clkid, freq);
+        c->actuations++;
+        clockadj_step(cmd->clkid, cmd->ns);
+        return;
+    }
+    c->actuations_merged++;
+    c->actuations++;
+    if (cc) {
+        cc->valid = !clockadj_step_freq(cmd->clkid, cmd->ns, freq);
+        cc->freq_word = clockadj_freq_word(freq);
+    } else {
+        clockadj_step_freq(cmd->clkid, cmd->ns, freq);
+    }
+}
+
+static void
+cache_dither(struct clock_cache* cc, double resolution)
+{
+    cc->resolution = resolution;
+    cc->residue = 0.0;
+}
+
+static void
+wake(struct follower* f)
+{
+    __atomic_add_fetch(&f->wake, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&f->waiting, __ATOMIC_SEQ_CST)) {
+        syscall(SYS_futex, &f->wake, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+    }
+}
+
+/* Hand the frequency to the followers, they apply it in parallel. */
+static void
+fan_out(const struct actuator_cmd* cmd)
+{
+    struct follower* f;
+    int i, n = __atomic_load_n(&n_followers, __ATOMIC_ACQUIRE);
+
+    for (i = 0; i < n; i++) {
+        f = &followers[i];
+        seqlock_write_begin(&f->seq);
+        f->freq = cmd->freq;
+        f->posted_ns = cmd->posted_ns;
+        seqlock_write_end(&f->seq);
+        wake(f);
+    }
+}
+
+/*
+ * Apply the newest posted frequency, frequencies posted while the previous
+ * one was applied are superseded.
+ */
+static void*
+follower_loop(void* arg)
+{
+    struct follower* f = arg;
+    struct actuator_follower_stats* st = &f->stats;
+    struct metrics_counters* c;
+    uint64_t posted, start, end, seen = 0, seq;
+    uint32_t w;
+    double freq;
+
+    metrics_register();
+    trace_register();
+    c = metrics_counters();
+
+    for (;;) {
+        __atomic_store_n(&f->waiting, 1, __ATOMIC_SEQ_CST);
+        w = __atomic_load_n(&f->wake, __ATOMIC_SEQ_CST);
+        if (seqlock_read_begin(&f->seq) == seen) {
+            /* Stop only once the last posted frequency is applied. */
+            if (__atomic_load_n(&f->stop, __ATOMIC_ACQUIRE)) {
+                return NULL;
+            }
+            syscall(SYS_futex, &f->wake, FUTEX_WAIT_PRIVATE, w, NULL, NULL, 0);
+        }
+        __atomic_store_n(&f->waiting, 0, __ATOMIC_RELAXED);
+        do {
+            seq = seqlock_read_begin(&f->seq);
+            freq = f->freq;
+            posted = f->posted_ns;
+        } while (seqlock_read_retry(&f->seq, seq));
+        if (seq == seen) {
+            continue;
+        }
+        /* Every posting advances the sequence by two. */
+        __atomic_store_n(&st->coalesced, st->coalesced + (seq - seen) / 2 - 1, __ATOMIC_RELAXED);
+        seen = seq;
+
+        start = now_ns();
+        set_freq(c, &f->cache, f->cache.clkid, freq);
+        end = now_ns();
+        __atomic_store_n(&st->actuations, st->actuations + 1, __ATOMIC_RELAXED);
+        __atomic_store_n(&st->queue_ns, st->queue_ns + start - posted, __ATOMIC_RELAXED);
+        __atomic_store_n(&st->apply_ns, st->apply_ns + end - start, __ATOMIC_RELAXED);
+        __atomic_store_n(&st->lag_ns, end - posted, __ATOMIC_RELAXED);
+    }
+}
+
+static void
+apply(const struct actuator_cmd* cmd)
+{
+    struct metrics_counters* c = metrics_counters();
+    struct clock_cache* cc;
+    uint64_t start, end;
+
+    start = now_ns();
+    switch (cmd->op) {
+    case ACTUATOR_SET_FREQ:
+        fan_out(cmd);
+        if (cmd->sample_ts) {
+            set_freq_measured(c, cmd);
+        } else {
+            set_freq(c, cache_get(cmd->clkid), cmd->clkid, cmd->freq);
+        }
+        break;
+    case ACTUATOR_STEP:
+        c->actuations++;
+        clockadj_step(cmd->clkid, cmd->ns);
+        break;
+    case ACTUATOR_SET_PHASE:
+        c->actuations++;
+        clockadj_set_phase(cmd->clkid, cmd->ns);
+        /*
+         * The kernel PLL may retune the system clock frequency to slew, a PHC
+         * removes the phase in hardware and keeps its frequency word.
+         */
+        if (cmd->clkid == CLOCK_REALTIME) {
+            cc = cache_get(cmd->clkid);
+            if (cc) {
+                cc->valid = 0;
+            }
+        }
+        break;
+    case ACTUATOR_JUMP:
+        fan_out(cmd);
+        jump(c, cmd);
+        break;
+    case ACTUATOR_STOP:
+        return;
+    }
+    end = now_ns();
+    c->actuation_queue_ns += start - cmd->posted_ns;
+    c->actuation_apply_ns += end - start;
+    trace_debug("actuation %d applied %" PRIu64 " ns after posting, took %" PRIu64 " ns",
+                cmd->op,
+                start - cmd->posted_ns,
+                end - start);
+}
+
+static void
+post(const struct actuator_cmd* cmd)
+{
+    uint32_t head = queue.head;
+
+    /* Only a driver stuck for the whole queue length gets here. */
+    while (head - __atomic_load_n(&queue.tail, __ATOMIC_ACQUIRE) >= ACTUATOR_QUEUE_LEN) {
+        sched_yield();
+    }
+    queue.cmds[head % ACTUATOR_QUEUE_LEN] = *cmd;
+    __atomic_store_n(&queue.head, head + 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&queue.waiting, __ATOMIC_SEQ_CST)) {
+        syscall(SYS_futex, &queue.head, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+    }
+}
+
+static void
+submit(struct actuator_cmd* cmd)
+{
+    /* The time stamp belongs to the next command only. */
+    next_sample_ts = 0;
+    cmd->posted_ns = now_ns();
+    if (started) {
+        post(cmd);
+    } else {
+        apply(cmd);
+    }
+}
+
+static void*
+actuator_loop(void* arg)
+{
+    struct actuator_cmd* cmd;
+    struct actuator_cmd* next;
+    uint32_t head, tail;
+
+    metrics_register();
+    trace_register();
+    for (;;) {
+        tail = queue.tail;
+        head = __atomic_load_n(&queue.head, __ATOMIC_ACQUIRE);
+        if (head == tail) {
+            /* Announce the wait, then check again before sleeping. */
+            __atomic_store_n(&queue.waiting, 1, __ATOMIC_SEQ_CST);
+            if (__atomic_load_n(&queue.head, __ATOMIC_SEQ_CST) == tail) {
+                syscall(SYS_futex, &queue.head, FUTEX_WAIT_PRIVATE, tail, NULL, NULL, 0);
+            }
+            __atomic_store_n(&queue.waiting, 0, __ATOMIC_RELAXED);
+            continue;
+        }
+        for (; tail != head; tail++) {
+            cmd = &queue.cmds[tail % ACTUATOR_QUEUE_LEN];
+            if (cmd->op == ACTUATOR_STOP) {
+                __atomic_store_n(&queue.tail, tail + 1, __ATOMIC_RELEASE);
+                return NULL;
+            }
+            next = &queue.cmds[(tail + 1) % ACTUATOR_QUEUE_LEN];
+            if (cmd->op == ACTUATOR_SET_FREQ && tail + 1 != head && next->op == ACTUATOR_SET_FREQ &&
+                next->clkid == cmd->clkid) {
+                /* Superseded by the next command. */
+                metrics_inc(actuations_coalesced);
+            } else {
+                apply(cmd);
+            }
+            __atomic_store_n(&queue.tail, tail + 1, __ATOMIC_RELEASE);
+        }
+    }
+}
+
+/******************************************************************************
+ * Public Functions
+ *****************************************************************************/
+int
+actuator_start()
+{
+    if (pthread_create(&actuator_thread, NULL, actuator_loop, NULL)) {
+        pr_err("actuator: cannot create thread");
+        return -1;
+    }
+    pthread_setname_np(actuator_thread, "ext_servo_act");
+    started = 1;
+    return 0;
+}
+
+int
+actuator_follow(clockid_t clkid, const char* device, int dither, double resolution)
+{
+    struct follower* f;
+
+    if (n_followers == ACTUATOR_MAX_FOLLOWERS) {
+        pr_err("actuator: more than %d follower devices", ACTUATOR_MAX_FOLLOWERS);
+        return -1;
+    }
+    f = &followers[n_followers];
+    memset(f, 0, sizeof(*f));
+    f->cache.clkid = clkid;
+    f->cache.used = 1;
+    if (dither) {
+        cache_dither(&f->cache, resolution);
+    }
+    strncpy(f->stats.device, device, sizeof(f->stats.device) - 1);
+    if (pthread_create(&f->thread, NULL, follower_loop, f)) {
+        pr_err("actuator: cannot create thread for %s", device);
+        return -1;
+    }
+    pthread_setname_np(f->thread, "ext_servo_fol");
+    /* Published last, the applying thread may fan out right away. */
+    __atomic_store_n(&n_followers, n_followers + 1, __ATOMIC_RELEASE);
+    pr_info("actuator: %s follows the frequency", device);
+    return 0;
+}
+
+int
+actuator_follower_stats(int i, struct actuator_follower_stats* stats)
+{
+    struct actuator_follower_stats* st;
+
+    if (i < 0 || i >= __atomic_load_n(&n_followers, __ATOMIC_ACQUIRE)) {
+        return -1;
+    }
+    st = &followers[i].stats;
+    memcpy(stats->device, st->device, sizeof(stats->device));
+    stats->actuations = __atomic_load_n(&st->actuations, __ATOMIC_RELAXED);
+    stats->coalesced = __atomic_load_n(&st->coalesced, __ATOMIC_RELAXED);
+    stats->queue_ns = __atomic_load_n(&st->queue_ns, __ATOMIC_RELAXED);
+    stats->apply_ns = __atomic_load_n(&st->apply_ns, __ATOMIC_RELAXED);
+    stats->lag_ns = __atomic_load_n(&st->lag_ns, __ATOMIC_RELAXED);
+    return 0;
+}
+
+void
+actuator_stop()
+{
+    struct actuator_cmd cmd = { .op = ACTUATOR_STOP };
+    struct follower* f;
+    int i;
+
+    if (started) {
+        post(&cmd);
+        pthread_join(actuator_thread, NULL);
+        started = 0;
+    }
+    /* The followers finish the frequency they are applying. */
+    for (i = 0; i < n_followers; i++) {
+        f = &followers[i];
+        __atomic_store_n(&f->stop, 1, __ATOMIC_SEQ_CST);
+        wake(f);
+        pthread_join(f->thread, NULL);
+    }
+    n_followers = 0;
+}
+
+int
+actuator_dither(clockid_t clkid, double resolution)
+{
+    struct clock_cache* cc = cache_get(clkid);
+
+    if (!cc) {
+        pr_err("actuator: no room to dither clock %d", (int)clkid);
+        return -1;
+    }
+    cache_dither(cc, resolution);
+    pr_info("actuator: dithering the frequency in steps of %.4f ppb", cc->resolution);
+    return 0;
+}
+
+void
+actuator_measure_delay(clockid_t clkid)
+{
+    delay_clkid = clkid;
+    delay_measured = 1;
+}
+
+void
+actuator_sample_ts(uint64_t ts)
+{
+    if (delay_measured) {
+        next_sample_ts = ts;
+    }
+}
+
+int64_t
+actuator_delay()
+{
+    return __atomic_load_n(&delay_avg, __ATOMIC_RELAXED);
+}
+
+void
+actuator_set_freq(clockid_t clkid, double freq)
+{
+    struct actuator_cmd cmd = { .op = ACTUATOR_SET_FREQ, .clkid = clkid, .freq = freq, .sample_ts = next_sample_ts };
+
+    submit(&cmd);
+}
+
+void
+actuator_step(clockid_t clkid, int64_t step)
+{
+    struct actuator_cmd cmd = { .op = ACTUATOR_STEP, .clkid = clkid, .ns = step };
+
+    submit(&cmd);
+}
+
+void
+actuator_jump(clockid_t clkid, double freq, clockid_t tod_clkid, int64_t step)
+{
+    struct actuator_cmd cmd = { .op = ACTUATOR_JUMP, .clkid = clkid, .tod_clkid = tod_clkid, .freq = freq, .ns = step };
+
+    submit(&cmd);
+}
+
+void
+actuator_set_phase(clockid_t clkid, long offset)
+{
+    struct actuator_cmd cmd = { .op = ACTUATOR_SET_PHASE, .clkid = clkid, .ns = offset };
+
+    submit(&cmd);
+}
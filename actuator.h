@@ -0,0 +1,171 @@
+/**
+ * @file actuator.h
+ * @brief Clock actuation, inline or on a dedicated thread.
+ * @note Copyright (C) 2022 SyncMonk Technologies <services@syncmonk.net>
+ * @note SPDX-License-Identifier: GPL-2.0+
+ *
+ * Inline, the commands call clockadj directly. Pipelined, the sample path
+ * posts them to a single producer / single consumer queue and the
+ * actuation thread applies them in order, so a slow PHC driver never
+ * delays the next receive. When several frequency commands for the same
+ * clock are pending back to back only the newest one is applied. Steps
+ * and phase commands are never dropped.
+ *
+ * The applying thread caches the frequency word last written to each
+ * clock and skips writes which would not change it. A jump of the system
+ * clock sets the frequency and steps in one clock_adjtime() call, PHCs
+ * accept only one of the two per call.
+ *
+ * A dithered clock gets its frequency in multiples of its resolution, the
+ * quantization error of one write is added to the next one (first order
+ * sigma-delta), so on average the clock runs at the servo frequency.
+ *
+ * Follower devices share the oscillator domain of the frequency clock and
+ * get every frequency of it. Each has a thread of its own, so a slow
+ * driver delays neither the others nor the frequency clock; a follower
+ * that falls behind skips to the newest frequency. Steps and phase
+ * adjustments are not forwarded.
+ *
+ * Both modes account the time from posting to the start of the
+ * clock_adjtime() call and the time spent in it.
+ *
+ * A frequency tagged with the time stamp of its sample is written between
+ * two readings of the clock of the samples. The midpoint minus the time
+ * stamp is the actuation delay: ptp4l, the socket, the servo, the queue
+ * and the driver. A frequency whose word is kept is not measured. The
+ * moving average goes back to the servo, which accounts for the frequency
+ * left running over that gap.
+ */
+
+#ifndef __ACTUATOR_H__
+#define __ACTUATOR_H__
+
+#include <stdint.h>
+#include <time.h>
+
+/*! Queue length, a power of 2. */
+#define ACTUATOR_QUEUE_LEN 64
+
+/*! Follower devices of the frequency clock. */
+#define ACTUATOR_MAX_FOLLOWERS 8
+
+/**
+ * @brief Actuation statistics of a follower device.
+ */
+struct actuator_follower_stats
+{
+    char device[32];
+    /*! Frequencies applied. */
+    uint64_t actuations;
+    /*! Frequencies superseded before they were applied. */
+    uint64_t coalesced;
+    /*! Time from posting to the clock_adjtime() call [ns]. */
+    uint64_t queue_ns;
+    /*! Time in clock_adjtime() [ns]. */
+    uint64_t apply_ns;
+    /*! Time from posting to the end of the last write [ns]. */
+    uint64_t lag_ns;
+};
+
+/**
+ * @brief Start the actuation thread, commands are applied inline until then.
+ *
+ * @return 0 on success, -1 otherwise.
+ */
+int
+actuator_start();
+
+/**
+ * @brief Add a follower device and start its thread.
+ *
+ * @param [in] clkid Clock of the device.
+ * @param [in] device Name of the device.
+ * @param [in] dither Dither the frequency, see actuator_dither().
+ * @param [in] resolution Frequency step of the device [ppb], used with dither.
+ * @return 0 on success, -1 otherwise.
+ */
+int
+actuator_follow(clockid_t clkid, const char* device, int dither, double resolution);
+
+/**
+ * @brief Read the statistics of a follower device.
+ *
+ * @param [in] i Index of the follower.
+ * @param [out] stats Statistics.
+ * @return 0 on success, -1 past the last follower.
+ */
+int
+actuator_follower_stats(int i, struct actuator_follower_stats* stats);
+
+/**
+ * @brief Apply all pending commands and stop the actuation and follower threads.
+ */
+void
+actuator_stop();
+
+/**
+ * @brief Dither the frequency of a clock, before actuator_start().
+ *
+ * @param [in] clkid Frequency clock.
+ * @param [in] resolution Frequency step of the clock [ppb].
+ * @return 0 on success, -1 otherwise.
+ */
+int
+actuator_dither(clockid_t clkid, double resolution);
+
+/**
+ * @brief Measure the actuation delay of tagged frequencies, before the
+ *        first command.
+ *
+ * @param [in] clkid Clock in the time scale of the sample time stamps.
+ */
+void
+actuator_measure_delay(clockid_t clkid);
+
+/**
+ * @brief Tag the next command with the time stamp of its sample, only a
+ *        frequency is measured.
+ *
+ * @param [in] ts Local time stamp of the sample [ns].
+ */
+void
+actuator_sample_ts(uint64_t ts);
+
+/**
+ * @brief Moving average of the actuation delay.
+ *
+ * @return Delay from the sample to the frequency write [ns], 0 until measured.
+ */
+int64_t
+actuator_delay();
+
+/**
+ * @brief Set the frequency offset, see clockadj_set_freq().
+ */
+void
+actuator_set_freq(clockid_t clkid, double freq);
+
+/**
+ * @brief Step the clock, see clockadj_step().
+ */
+void
+actuator_step(clockid_t clkid, int64_t step);
+
+/**
+ * @brief Set the frequency and step the time of day clock.
+ *
+ * @param [in] clkid Frequency clock.
+ * @param [in] freq Frequency offset [ppb].
+ * @param [in] tod_clkid Time of day clock.
+ * @param [in] step Time step [ns].
+ */
+void
+actuator_jump(clockid_t clkid, double freq, clockid_t tod_clkid, int64_t step);
+
+/**
+ * @brief Set the phase offset, see clockadj_set_phase().
+ */
+void
+actuator_set_phase(clockid_t clkid, long offset);
+
+#endif /* __ACTUATOR_H__ */
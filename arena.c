@@ -0,0 +1,102 @@
+/**
+ * @file arena.c
+ * @note Copyright (C) 2022 SyncMonk Technologies <services@syncmonk.net>
+ * @note SPDX-License-Identifier: GPL-2.0+
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "arena.h"
+#include "logger.h"
+/******************************************************************************
+ * Local Definitions
+ *****************************************************************************/
+static uint8_t* base;
+static size_t arena_size;
+static size_t used;
+/* Allocations which did not fit and came from calloc(). */
+static unsigned int overflows;
+
+/******************************************************************************
+ * Public Functions
+ *****************************************************************************/
+int
+arena_open(size_t size)
+{
+    void* map;
+
+    size = (size + 4095) & ~(size_t)4095;
+    map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (map == MAP_FAILED) {
+        pr_err("arena: cannot map %zu bytes: %m", size);
+        return -1;
+    }
+    base = map;
+    arena_size = size;
+    used = 0;
+    overflows = 0;
+    return 0;
+}
+
+void
+arena_close()
+{
+    if (!base) {
+        return;
+    }
+    munmap(base, arena_size);
+    base = NULL;
+    arena_size = used = 0;
+}
+
+void*
+arena_calloc(size_t n, size_t size)
+{
+    size_t len;
+    void* ptr;
+
+    if (size && n > SIZE_MAX / size) {
+        return NULL;
+    }
+    len = (n * size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    if (base && len <= arena_size - used) {
+        /* The mapping is zero filled and memory is never reused. */
+        ptr = base + used;
+        used += len;
+        return ptr;
+    }
+    if (base) {
+        overflows++;
+        pr_warning("arena: %zu bytes do not fit, taken from the heap", n * size);
+    }
+    if (posix_memalign(&ptr, ARENA_ALIGN, len ? len : ARENA_ALIGN)) {
+        return NULL;
+    }
+    memset(ptr, 0, len);
+    return ptr;
+}
+
+void
+arena_free(void* ptr)
+{
+    if (base && (uint8_t*)ptr >= base && (uint8_t*)ptr < base + arena_size) {
+        return;
+    }
+    free(ptr);
+}
+
+void
+arena_report()
+{
+    if (!base) {
+        return;
+    }
+    if (overflows) {
+        pr_warning("arena: %zu of %zu bytes used, %u allocations from the heap", used, arena_size, overflows);
+    } else {
+        pr_info("arena: %zu of %zu bytes used", used, arena_size);
+    }
+}
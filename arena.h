@@ -0,0 +1,61 @@
+/**
+ * @file arena.h
+ * @brief Preallocated arena for the state of the sample path.
+ * @note Copyright (C) 2022 SyncMonk Technologies <services@syncmonk.net>
+ * @note SPDX-License-Identifier: GPL-2.0+
+ *
+ * The arena is mapped and prefaulted once at startup. tsproc, filters,
+ * outlier windows and servos take their state from it in creation order,
+ * so the state of one instance is contiguous and every object starts on
+ * its own cache line. Memory is never returned to the arena, objects live
+ * until exit.
+ *
+ * While no arena is open (e.g. in the benchmarks), or once it is full,
+ * arena_calloc() falls back to the heap, arena_free() tells both apart.
+ */
+
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include <stddef.h>
+
+#define ARENA_ALIGN 64
+
+/**
+ * @brief Map and prefault the arena.
+ *
+ * @param [in] size Size in bytes.
+ * @return 0 on success, -1 otherwise.
+ */
+int
+arena_open(size_t size);
+
+/**
+ * @brief Unmap the arena, all objects in it must be destroyed.
+ */
+void
+arena_close();
+
+/**
+ * @brief Allocate zeroed memory aligned to ARENA_ALIGN.
+ *
+ * @param [in] n Number of elements.
+ * @param [in] size Size of one element.
+ * @return Memory, NULL if out of memory.
+ */
+void*
+arena_calloc(size_t n, size_t size);
+
+/**
+ * @brief Release memory of arena_calloc(), a no-op for arena memory.
+ */
+void
+arena_free(void* ptr);
+
+/**
+ * @brief Log the arena usage.
+ */
+void
+arena_report();
+
+#endif /* __ARENA_H__ */
@@ -0,0 +1,138 @@
+/**
+ * @file bench.c
+ * @note Copyright (C) 2022 SyncMonk Technologies <services@syncmonk.net>
+ * @note SPDX-License-Identifier: GPL-2.0+
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <asm/byteorder.h>
+
+#include "bench.h"
+#include "msg.h"
+
+#define BENCH_WARMUP 256
+
+static int
+cmp_double(const void* a, const void* b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
+static double
+percentile(double* sorted, int count, double p)
+{
+    int idx = p * (count - 1) + 0.5;
+    return sorted[idx];
+}
+
+void
+bench_report(const char* name, const char* variant, double* samples, int count)
+{
+    double sum = 0.0;
+    int i;
+
+    if (count <= 0) {
+        return;
+    }
+    qsort(samples, count, sizeof(*samples), cmp_double);
+    for (i = 0; i < count; i++) {
+        sum += samples[i];
+    }
+    printf("{\"bench\":\"%s\",\"variant\":\"%s\",\"count\":%d,\"unit\":\"ns\",\"mean\":%.2f,\"min\":%.2f,"
+           "\"p50\":%.2f,\"p90\":%.2f,\"p99\":%.2f,\"p999\":%.2f,\"max\":%.2f}\n",
+           name,
+           variant,
+           count,
+           sum / count,
+           samples[0],
+           percentile(samples, count, 0.50),
+           percentile(samples, count, 0.90),
+           percentile(samples, count, 0.99),
+           percentile(samples, count, 0.999),
+           samples[count - 1]);
+    fflush(stdout);
+}
+
+void
+bench_run(const char* name, const char* variant, bench_op op, void* arg)
+{
+    static double samples[BENCH_BATCHES];
+    uint64_t start;
+    int i, j;
+
+    for (i = 0; i < BENCH_WARMUP; i++) {
+        op(arg);
+    }
+    for (i = 0; i < BENCH_BATCHES; i++) {
+        start = bench_now_ns();
+        for (j = 0; j < BENCH_BATCH; j++) {
+            op(arg);
+        }
+        samples[i] = (double)(bench_now_ns() - start) / BENCH_BATCH;
+    }
+    bench_report(name, variant, samples, BENCH_BATCHES);
+}
+
+static struct Timestamp
+ns_to_timestamp(uint64_t ns)
+{
+    struct Timestamp ts;
+
+    ts.seconds_msb = 0;
+    ts.seconds_lsb = htonl(ns / 1000000000ULL);
+    ts.nanoseconds = htonl(ns % 1000000000ULL);
+    return ts;
+}
+
+static int
+build_signaling(uint8_t* buf, uint16_t tlv_type, uint16_t tlv_len)
+{
+    struct signaling_msg* msg = (struct signaling_msg*)buf;
+    struct tlv* tlv = (struct tlv*)msg->suffix;
+    int len = sizeof(*msg) + sizeof(*tlv) + tlv_len;
+
+    memset(buf, 0, len);
+    msg->header.msmt = SIGNALING;
+    msg->header.version = 2;
+    msg->header.messageLength = htons(len);
+    tlv->type = htons(tlv_type);
+    tlv->length = htons(tlv_len);
+    return len;
+}
+
+int
+bench_build_sync_msg(uint8_t* buf, uint16_t seq, uint64_t t1, uint64_t t2)
+{
+    struct signaling_msg* msg = (struct signaling_msg*)buf;
+    struct slave_rx_sync_timing_data_tlv* tlv = (struct slave_rx_sync_timing_data_tlv*)msg->suffix;
+    struct slave_rx_sync_timing_record* rec = tlv->record;
+    int len;
+
+    len = build_signaling(buf, TLV_SLAVE_RX_SYNC_TIMING_DATA, sizeof(struct PortIdentity) + sizeof(*rec));
+    rec->sequenceId = htons(seq);
+    rec->syncOriginTimestamp = ns_to_timestamp(t1);
+    rec->totalCorrectionField = 0;
+    rec->scaledCumulativeRateOffset = 0;
+    rec->syncEventIngressTimestamp = ns_to_timestamp(t2);
+    return len;
+}
+
+int
+bench_build_delay_msg(uint8_t* buf, uint16_t seq, uint64_t t3, uint64_t t4)
+{
+    struct signaling_msg* msg = (struct signaling_msg*)buf;
+    struct slave_delay_timing_data_tlv* tlv = (struct slave_delay_timing_data_tlv*)msg->suffix;
+    struct slave_delay_timing_record* rec = tlv->record;
+    int len;
+
+    len = build_signaling(buf, SLAVE_DELAY_TIMING_DATA_NP, sizeof(struct PortIdentity) + sizeof(*rec));
+    rec->sequenceId = htons(seq);
+    rec->delayOriginTimestamp = ns_to_timestamp(t3);
+    rec->totalCorrectionField = 0;
+    rec->delayResponseTimestamp = ns_to_timestamp(t4);
+    return len;
+}
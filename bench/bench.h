@@ -0,0 +1,96 @@
+/**
+ * @file bench.h
+ * @brief Helpers shared by the benchmark programs.
+ * @note Copyright (C) 2022 SyncMonk Technologies <services@syncmonk.net>
+ * @note SPDX-License-Identifier: GPL-2.0+
+ */
+
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+#include <stdint.h>
+#include <time.h>
+
+/** Number of operations timed together as one batch. */
+#define BENCH_BATCH 64
+/** Number of timed batches per benchmark case. */
+#define BENCH_BATCHES 4096
+
+/**
+ * @brief Read the monotonic clock.
+ *
+ * @return Current CLOCK_MONOTONIC time in nanoseconds.
+ */
+static inline uint64_t
+bench_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * @brief Keep the compiler from optimizing away a computed value.
+ */
+#define bench_keep(_val_) __asm__ __volatile__("" : : "g"(_val_) : "memory")
+
+/**
+ * @brief Operation under test, called once per iteration.
+ *
+ * @param [in] arg Benchmark specific context.
+ */
+typedef void (*bench_op)(void* arg);
+
+/**
+ * @brief Time an operation and print the result.
+ *
+ * The operation is timed in batches of BENCH_BATCH calls. The per call
+ * time of every batch is one observation, percentiles are taken over the
+ * observations. The result is printed as one JSON object per line so that
+ * runs of different builds can be compared with standard tools.
+ *
+ * @param [in] name Benchmark name.
+ * @param [in] variant Benchmark variant, e.g. filter type and length.
+ * @param [in] op Operation to time.
+ * @param [in] arg Context passed to the operation.
+ */
+extern void
+bench_run(const char* name, const char* variant, bench_op op, void* arg);
+
+/**
+ * @brief Print a latency distribution collected by the caller.
+ *
+ * @param [in] name Benchmark name.
+ * @param [in] variant Benchmark variant.
+ * @param [in] samples Observations in nanoseconds, sorted in place.
+ * @param [in] count Number of observations.
+ */
+extern void
+bench_report(const char* name, const char* variant, double* samples, int count);
+
+/**
+ * @brief Build a signaling message carrying TLV_SLAVE_RX_SYNC_TIMING_DATA.
+ *
+ * @param [out] buf Message buffer.
+ * @param [in] seq Sequence ID of the record.
+ * @param [in] t1 Sync origin timestamp in nanoseconds.
+ * @param [in] t2 Sync ingress timestamp in nanoseconds.
+ * @return Length of the message.
+ */
+extern int
+bench_build_sync_msg(uint8_t* buf, uint16_t seq, uint64_t t1, uint64_t t2);
+
+/**
+ * @brief Build a signaling message carrying SLAVE_DELAY_TIMING_DATA_NP.
+ *
+ * @param [out] buf Message buffer.
+ * @param [in] seq Sequence ID of the record.
+ * @param [in] t3 Delay request origin timestamp in nanoseconds.
+ * @param [in] t4 Delay response timestamp in nanoseconds.
+ * @return Length of the message.
+ */
+extern int
+bench_build_delay_msg(uint8_t* buf, uint16_t seq, uint64_t t3, uint64_t t4);
+
+#endif /* __BENCH_H__ */
@@ -0,0 +1,130 @@
+/**
+ * @file clockadj_record.c
+ * @brief clockadj replacement that records adjustments instead of applying them.
+ * @note Copyright (C) 2022 SyncMonk Technologies <services@syncmonk.net>
+ * @note SPDX-License-Identifier: GPL-2.0+
+ *
+ * Every adjustment is timestamped on entry and written as a struct
+ * clockadj_record to the descriptor named by EXT_SERVO_RECORD_FD, so that a
+ * benchmark can measure the time from datagram transmission to actuation
+ * through the real ext_servo main loop.
+ */
+
+#define LOG_SUBSYS LOG_SUBSYS_CLOCKADJ
+
+#include <errno.h>
+#include <stdlib.h>
+#include <sys/timex.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "clockadj.h"
+#include "clockadj_record.h"
+#include "logger.h"
+#include "trace.h"
+
+static int record_fd = -2;
+
+static void
+record(clockid_t clkid, uint32_t modes, double value)
+{
+    struct clockadj_record rec;
+    const char* env;
+
+    rec.ts = bench_now_ns();
+    rec.modes = modes;
+    rec.clkid = clkid;
+    rec.value = value;
+
+    if (record_fd == -2) {
+        env = getenv(CLOCKADJ_RECORD_FD_ENV);
+        record_fd = env ? atoi(env) : -1;
+    }
+    if (record_fd >= 0 && write(record_fd, &rec, sizeof(rec)) != sizeof(rec)) {
+        pr_err("failed to write clock adjustment record: %m");
+    }
+}
+
+void
+clockadj_init(clockid_t clkid)
+{
+}
+
+int
+clockadj_set_freq(clockid_t clkid, double freq)
+{
+    record(clkid, ADJ_FREQUENCY, freq);
+    trace_debug("%s freq: %f", __func__, freq);
+    return 0;
+}
+
+double
+clockadj_get_freq(clockid_t clkid)
+{
+    return 0.0;
+}
+
+int
+clockadj_set_phase(clockid_t clkid, long offset)
+{
+    record(clkid, ADJ_OFFSET | ADJ_NANO, offset);
+    return 0;
+}
+
+int
+clockadj_step(clockid_t clkid, int64_t step)
+{
+    record(clkid, ADJ_SETOFFSET | ADJ_NANO, step);
+    pr_debug("%s : %ld", __func__, step);
+    return 0;
+}
+
+/* One call, recorded as the step followed by the frequency. */
+int
+clockadj_step_freq(clockid_t clkid, int64_t step, double freq)
+{
+    record(clkid, ADJ_SETOFFSET | ADJ_NANO, step);
+    record(clkid, ADJ_FREQUENCY, freq);
+    pr_debug("%s : %ld freq: %f", __func__, step, freq);
+    return 0;
+}
+
+int
+clockadj_max_phase(clockid_t clkid)
+{
+    return 0;
+}
+
+int
+clockadj_max_freq(clockid_t clkid)
+{
+    return 500000;
+}
+
+int
+clockadj_compare(clockid_t clkid, clockid_t sysclk, int readings, int64_t* offset, uint64_t* ts, int64_t* delay)
+{
+    return -EOPNOTSUPP;
+}
+
+void
+sysclk_set_leap(int leap)
+{
+}
+
+void
+sysclk_set_tai_offset(int offset)
+{
+}
+
+int
+sysclk_max_freq(void)
+{
+    return 500000;
+}
+
+void
+sysclk_set_sync(void)
+{
+    record(CLOCK_REALTIME, ADJ_STATUS | ADJ_MAXERROR, 0.0);
+}
@@ -0,0 +1,31 @@
+/**
+ * @file clockadj_record.h
+ * @brief Record format of the recording clockadj backend.
+ * @note Copyright (C) 2022 SyncMonk Technologies <services@syncmonk.net>
+ * @note SPDX-License-Identifier: GPL-2.0+
+ */
+
+#ifndef __CLOCKADJ_RECORD_H__
+#define __CLOCKADJ_RECORD_H__
+
+#include <stdint.h>
+
+/** Environment variable holding the file descriptor records are written to. */
+#define CLOCKADJ_RECORD_FD_ENV "EXT_SERVO_RECORD_FD"
+
+/**
+ * @brief One clock adjustment as seen by the recording backend.
+ */
+struct clockadj_record
+{
+    /*! CLOCK_MONOTONIC time of the clockadj_*() call in nanoseconds. */
+    uint64_t ts;
+    /*! timex modes the real backend would have used. */
+    uint32_t modes;
+    /*! Clock the adjustment was meant for. */
+    int32_t clkid;
+    /*! Frequency (ppb) or offset (ns) of the adjustment. */
+    double value;
+};
+
+#endif /* __CLOCKADJ_RECORD_H__ */
@@ -0,0 +1,99 @@
+/**
+ * @file clockadj_stub.c
+ * @brief clockadj replacement for benchmarks, no clock is touched.
+ * @note Copyright (C) 2022 SyncMonk Technologies <services@syncmonk.net>
+ * @note SPDX-License-Identifier: GPL-2.0+
+ */
+
+#include <errno.h>
+
+#include "clockadj.h"
+
+/* Written so that calls into the stub are not optimized away. */
+volatile double clockadj_stub_freq;
+volatile int64_t clockadj_stub_offset;
+volatile unsigned long clockadj_stub_calls;
+
+void
+clockadj_init(clockid_t clkid)
+{
+}
+
+int
+clockadj_set_freq(clockid_t clkid, double freq)
+{
+    clockadj_stub_freq = freq;
+    clockadj_stub_calls++;
+    return 0;
+}
+
+double
+clockadj_get_freq(clockid_t clkid)
+{
+    return clockadj_stub_freq;
+}
+
+int
+clockadj_set_phase(clockid_t clkid, long offset)
+{
+    clockadj_stub_offset = offset;
+    clockadj_stub_calls++;
+    return 0;
+}
+
+int
+clockadj_step(clockid_t clkid, int64_t step)
+{
+    clockadj_stub_offset = step;
+    clockadj_stub_calls++;
+    return 0;
+}
+
+int
+clockadj_step_freq(clockid_t clkid, int64_t step, double freq)
+{
+    clockadj_stub_offset = step;
+    clockadj_stub_freq = freq;
+    clockadj_stub_calls++;
+    return 0;
+}
+
+int
+clockadj_max_phase(clockid_t clkid)
+{
+    return 0;
+}
+
+int
+clockadj_max_freq(clockid_t clkid)
+{
+    return 500000;
+}
+
+int
+clockadj_compare(clockid_t clkid, clockid_t sysclk, int readings, int64_t* offset, uint64_t* ts, int64_t* delay)
+{
+    return -EOPNOTSUPP;
+}
+
+void
+sysclk_set_leap(int leap)
+{
+}
+
+void
+sysclk_set_tai_offset(int offset)
+{
+}
+
+int
+sysclk_max_freq(void)
+{
+    return 500000;
+}
+
+void
+sysclk_set_sync(void)
+{
+    clockadj_stub_calls++;
+}
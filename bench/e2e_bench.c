@@ -0,0 +1,375 @@
+/**
+ * @file e2e_bench.c
+ * @brief End to end latency from datagram transmission to clock actuation.
+ * @note Copyright (C) 2022 SyncMonk Technologies <services@syncmonk.net>
+ * @note SPDX-License-Identifier: GPL-2.0+
+ *
+ * Runs the ext_servo main loop built against the recording clockadj
+ * backend, feeds it TLV datagrams over the monitor socket and measures the
+ * time between sendto() and the clockadj_set_freq() call triggered by each
+ * datagram. A datagram whose frequency word is unchanged is not written;
+ * such samples are told apart through the skipped actuations counter of
+ * the metrics endpoint and are not timed. Scenarios cover log levels 6
+ * and 7, with and without a busy loop on every CPU.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/timex.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "clockadj_record.h"
+
+#define DEFAULT_SAMPLES 2000
+#define MAX_PKT_LEN 1500
+#define MAX_CPUS 256
+
+/* Wait for the actuation of one datagram. */
+#define RECORD_TIMEOUT_MS 1000
+/* Wait before asking the daemon whether the frequency write was skipped. */
+#define SKIP_CHECK_MS 10
+/* Large enough for the whole metrics response. */
+#define SCRAPE_LEN (1 << 17)
+/* Gap between datagrams, lets the daemon go back to poll(). */
+#define SEND_GAP_US 200
+
+/* Path delay and master offset of the simulated link. */
+#define BENCH_DELAY 5000
+#define BENCH_OFFSET 100
+
+struct scenario
+{
+    const char* name;
+    int log_level;
+    int contended;
+};
+
+struct daemon
+{
+    pid_t pid;
+    int record_fd;
+    int sock;
+    struct sockaddr_un addr;
+    struct sockaddr_un metrics;
+    char config[64];
+};
+
+static int
+write_config(const char* path, const char* uds, const char* metrics, int log_level)
+{
+    FILE* fp;
+
+    fp = fopen(path, "w");
+    if (!fp) {
+        return -1;
+    }
+    fprintf(fp,
+            "logging:\n"
+            "    logging_level: %d\n"
+            "    use_syslog: 0\n"
+            "    msg_tag: bench\n"
+            "    use_stdout: 1\n"
+            "\n"
+            "servo:\n"
+            "    type: pi\n"
+            "    software_timestamp: 0\n"
+            "    step_threshold: 0.0\n"
+            "    first_step_threshold: 0.0\n"
+            "    pi_proportional_exponent: -0.3\n"
+            "    pi_proportional_norm_max: 0.7\n"
+            "    pi_integral_exponent: 0.4\n"
+            "    pi_integral_norm_max: 0.3\n"
+            "\n"
+            "device:\n"
+            "    monitor_uds_address: %s\n"
+            "    tsproc_mode: filter\n"
+            "    delay_filter: moving_median\n"
+            "    delay_filter_length: 10\n"
+            "    poll_time: 1\n"
+            "\n"
+            "metrics:\n"
+            "    uds_address: %s\n",
+            log_level,
+            uds,
+            metrics);
+    fclose(fp);
+    return 0;
+}
+
+static int
+daemon_start(struct daemon* d, const char* binary, int log_level)
+{
+    char fd_str[16];
+    int fds[2], null_fd;
+
+    memset(d, 0, sizeof(*d));
+    d->addr.sun_family = AF_LOCAL;
+    snprintf(d->addr.sun_path, sizeof(d->addr.sun_path), "/tmp/e2e_bench.%d", getpid());
+    d->metrics.sun_family = AF_LOCAL;
+    snprintf(d->metrics.sun_path, sizeof(d->metrics.sun_path), "/tmp/e2e_bench.%d.metrics", getpid());
+    snprintf(d->config, sizeof(d->config), "/tmp/e2e_bench.%d.yml", getpid());
+    if (write_config(d->config, d->addr.sun_path, d->metrics.sun_path, log_level)) {
+        return -1;
+    }
+    if (pipe(fds)) {
+        return -1;
+    }
+
+    d->pid = fork();
+    if (d->pid < 0) {
+        return -1;
+    }
+    if (d->pid == 0) {
+        close(fds[0]);
+        snprintf(fd_str, sizeof(fd_str), "%d", fds[1]);
+        setenv(CLOCKADJ_RECORD_FD_ENV, fd_str, 1);
+        null_fd = open("/dev/null", O_WRONLY);
+        dup2(null_fd, STDOUT_FILENO);
+        dup2(null_fd, STDERR_FILENO);
+        execl(binary, binary, "-f", d->config, (char*)NULL);
+        _exit(127);
+    }
+    close(fds[1]);
+    d->record_fd = fds[0];
+
+    d->sock = socket(AF_LOCAL, SOCK_DGRAM, 0);
+    return d->sock < 0 ? -1 : 0;
+}
+
+static void
+daemon_stop(struct daemon* d)
+{
+    kill(d->pid, SIGKILL);
+    waitpid(d->pid, NULL, 0);
+    close(d->record_fd);
+    close(d->sock);
+    unlink(d->addr.sun_path);
+    unlink(d->metrics.sun_path);
+    unlink(d->config);
+}
+
+static int
+daemon_send(struct daemon* d, uint8_t* msg, int len)
+{
+    return sendto(d->sock, msg, len, 0, (struct sockaddr*)&d->addr, sizeof(d->addr));
+}
+
+/*
+ * Read a counter from the metrics endpoint, -1 on error. The daemon
+ * processes the datagrams already queued before it answers.
+ */
+static long long
+daemon_counter(struct daemon* d, const char* name)
+{
+    static const char request[] = "GET /metrics HTTP/1.0\r\n\r\n";
+    static char buf[SCRAPE_LEN];
+    char pattern[128];
+    int fd, n, len = 0;
+    char* p;
+
+    fd = socket(AF_LOCAL, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr*)&d->metrics, sizeof(d->metrics)) ||
+        write(fd, request, sizeof(request) - 1) != sizeof(request) - 1) {
+        close(fd);
+        return -1;
+    }
+    while (len < (int)sizeof(buf) - 1 && (n = read(fd, buf + len, sizeof(buf) - 1 - len)) > 0) {
+        len += n;
+    }
+    close(fd);
+    buf[len] = '\0';
+
+    snprintf(pattern, sizeof(pattern), "\n%s{", name);
+    p = strstr(buf, pattern);
+    p = p ? strchr(p, '}') : NULL;
+    return p ? strtoll(p + 1, NULL, 10) : -1;
+}
+
+/* Wait for the next frequency adjustment, returns its timestamp or 0. */
+static uint64_t
+wait_freq_record(struct daemon* d, int timeout_ms)
+{
+    struct pollfd pfd = { .fd = d->record_fd, .events = POLLIN };
+    struct clockadj_record rec;
+
+    while (poll(&pfd, 1, timeout_ms) > 0) {
+        if (read(d->record_fd, &rec, sizeof(rec)) != sizeof(rec)) {
+            return 0;
+        }
+        if (rec.modes & ADJ_FREQUENCY) {
+            return rec.ts;
+        }
+    }
+    return 0;
+}
+
+/* Discard records of adjustments following the measured one. */
+static void
+drain_records(struct daemon* d)
+{
+    struct pollfd pfd = { .fd = d->record_fd, .events = POLLIN };
+    struct clockadj_record rec;
+
+    while (poll(&pfd, 1, 0) > 0) {
+        if (read(d->record_fd, &rec, sizeof(rec)) != sizeof(rec)) {
+            return;
+        }
+    }
+}
+
+static int
+start_contention(pid_t* pids)
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int i;
+
+    if (cpus > MAX_CPUS) {
+        cpus = MAX_CPUS;
+    }
+    for (i = 0; i < cpus; i++) {
+        pids[i] = fork();
+        if (pids[i] == 0) {
+            for (;;) {
+                __asm__ __volatile__("" ::: "memory");
+            }
+        }
+    }
+    return cpus;
+}
+
+static void
+stop_contention(pid_t* pids, int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+        if (pids[i] > 0) {
+            kill(pids[i], SIGKILL);
+            waitpid(pids[i], NULL, 0);
+        }
+    }
+}
+
+static int
+run_scenario(const char* binary, struct scenario* sc, int samples)
+{
+    struct timespec gap = { 0, SEND_GAP_US * 1000 };
+    uint8_t msg[MAX_PKT_LEN];
+    pid_t hogs[MAX_CPUS];
+    int i, len, n = 0, kept = 0, nhogs = 0;
+    long long skipped, count;
+    uint64_t t, sent, done;
+    struct daemon d;
+    double* lat;
+
+    lat = calloc(samples, sizeof(*lat));
+    if (!lat || daemon_start(&d, binary, sc->log_level)) {
+        fprintf(stderr, "%s: failed to start %s\n", sc->name, binary);
+        free(lat);
+        return -1;
+    }
+
+    /* Wait for the monitor socket, then seed the delay filter. */
+    t = 1000000000ULL;
+    len = bench_build_sync_msg(msg, 0, t, t + BENCH_DELAY + BENCH_OFFSET);
+    for (i = 0; i < 1000 && daemon_send(&d, msg, len) < 0; i++) {
+        usleep(1000);
+    }
+    len = bench_build_delay_msg(msg, 0, t + BENCH_DELAY, t + 2 * BENCH_DELAY - BENCH_OFFSET);
+    daemon_send(&d, msg, len);
+
+    /* Feed samples until the servo locks and adjusts the frequency. */
+    for (i = 1; i < 100; i++) {
+        t = (i + 1) * 1000000000ULL;
+        len = bench_build_sync_msg(msg, i, t, t + BENCH_DELAY + BENCH_OFFSET);
+        daemon_send(&d, msg, len);
+        if (wait_freq_record(&d, RECORD_TIMEOUT_MS)) {
+            break;
+        }
+    }
+    drain_records(&d);
+    skipped = daemon_counter(&d, "ext_servo_actuations_skipped_total");
+
+    if (sc->contended) {
+        nhogs = start_contention(hogs);
+    }
+
+    for (i = 0; i < samples; i++) {
+        t += 1000000000ULL;
+        len = bench_build_sync_msg(msg, i, t, t + BENCH_DELAY + BENCH_OFFSET + rand() % 200 - 100);
+        nanosleep(&gap, NULL);
+        drain_records(&d);
+        sent = bench_now_ns();
+        if (daemon_send(&d, msg, len) < 0) {
+            break;
+        }
+        done = wait_freq_record(&d, SKIP_CHECK_MS);
+        if (!done) {
+            count = daemon_counter(&d, "ext_servo_actuations_skipped_total");
+            if (count > skipped) {
+                skipped = count;
+                kept++;
+                continue;
+            }
+            done = wait_freq_record(&d, RECORD_TIMEOUT_MS);
+        }
+        if (!done) {
+            fprintf(stderr, "%s: no clock adjustment for sample %d\n", sc->name, i);
+            continue;
+        }
+        lat[n++] = done - sent;
+    }
+
+    stop_contention(hogs, nhogs);
+    daemon_stop(&d);
+
+    bench_report("e2e_sendto_to_clockadj", sc->name, lat, n);
+    if (kept) {
+        fprintf(stderr, "%s: %d samples kept the frequency word, not timed\n", sc->name, kept);
+    }
+    free(lat);
+    return n + kept == samples ? 0 : -1;
+}
+
+int
+main(int argc, char** argv)
+{
+    struct scenario scenarios[] = {
+        { "log6/idle", 6, 0 },
+        { "log7/idle", 7, 0 },
+        { "log6/contended", 6, 1 },
+        { "log7/contended", 7, 1 },
+    };
+    const char* binary;
+    unsigned int i;
+    int samples;
+    int rv = 0;
+
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <ext_servo_rec> [samples]\n", argv[0]);
+        return 1;
+    }
+    binary = argv[1];
+    samples = argc > 2 ? atoi(argv[2]) : DEFAULT_SAMPLES;
+
+    srand(1);
+    for (i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+        if (run_scenario(binary, &scenarios[i], samples)) {
+            rv = 1;
+        }
+    }
+    return rv;
+}
@@ -0,0 +1,508 @@
+/**
+ * @file hotpath_bench.c
+ * @brief Microbenchmarks of the msg/tsproc/filter/servo sample path.
+ * @note Copyright (C) 2022 SyncMonk Technologies <services@syncmonk.net>
+ * @note SPDX-License-Identifier: GPL-2.0+
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "actuator.h"
+#include "bench.h"
+#include "clockadj.h"
+#include "config.h"
+#include "filter.h"
+#include "hdrhist.h"
+#include "logger.h"
+#include "msg.h"
+#include "outlier.h"
+#include "servo.h"
+#include "trace.h"
+#include "tsproc.h"
+
+#define NUM_INPUTS 4096
+#define MAX_PKT_LEN 1500
+
+/* Path delay and master offset of the simulated link. */
+#define BENCH_DELAY 5000
+#define BENCH_OFFSET 100
+/* Frequency held while the device removes the phase [ppb]. */
+#define BENCH_FREQ 1234.5
+
+/* Clock ID of a PHC on descriptor 3, never opened, the stub takes the calls. */
+#define BENCH_PHC ((clockid_t)((~3u << 3) | 3))
+
+static int64_t noise[NUM_INPUTS];
+
+/* Calls into the clockadj stub. */
+extern volatile unsigned long clockadj_stub_calls;
+static int adjust_failures;
+
+/* Heap allocations of the sample path code, counted through -Wl,--wrap. */
+static unsigned long allocs;
+static int alloc_failures;
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t n, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+int __real_posix_memalign(void** ptr, size_t align, size_t size);
+
+void*
+__wrap_malloc(size_t size)
+{
+    allocs++;
+    return __real_malloc(size);
+}
+
+void*
+__wrap_calloc(size_t n, size_t size)
+{
+    allocs++;
+    return __real_calloc(n, size);
+}
+
+void*
+__wrap_realloc(void* ptr, size_t size)
+{
+    allocs++;
+    return __real_realloc(ptr, size);
+}
+
+int
+__wrap_posix_memalign(void** ptr, size_t align, size_t size)
+{
+    allocs++;
+    return __real_posix_memalign(ptr, align, size);
+}
+
+struct msg_ctx
+{
+    uint8_t msgs[2][MAX_PKT_LEN];
+    unsigned int n;
+};
+
+struct tsproc_ctx
+{
+    struct tsproc* tsp;
+    uint64_t now;
+    unsigned int n;
+};
+
+struct filter_ctx
+{
+    struct filter* filter;
+    unsigned int n;
+};
+
+struct outlier_ctx
+{
+    struct outlier* outlier;
+    unsigned int n;
+};
+
+struct servo_ctx
+{
+    struct servo* servo;
+    uint64_t local_ts;
+    unsigned int n;
+};
+
+struct offload_ctx
+{
+    unsigned int n;
+};
+
+struct hdrhist_ctx
+{
+    struct hdrhist hist;
+    unsigned int n;
+};
+
+struct pipeline_ctx
+{
+    struct tsproc* tsp;
+    struct servo* servo;
+    uint8_t msgs[NUM_INPUTS][2][128];
+    unsigned int n;
+};
+
+static void
+set_log_level(int level)
+{
+    struct logger_config cfg;
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.log_level = level;
+    cfg.use_stdout = 0;
+    cfg.use_syslog = 0;
+    cfg.msg_level = LOG_LEVEL_UNSET;
+    cfg.tsproc_level = LOG_LEVEL_UNSET;
+    cfg.servo_level = LOG_LEVEL_UNSET;
+    cfg.clockadj_level = LOG_LEVEL_UNSET;
+    strncpy(cfg.msg_tag, "bench", MAX_MSG_TAG_LEN - 1);
+    logger_configure(&cfg);
+}
+
+static void
+msg_op(void* arg)
+{
+    struct msg_ctx* c = arg;
+    int64_t master_time, slave_time;
+    uint16_t tlv_type;
+
+    process_message(c->msgs[c->n++ & 1], &tlv_type, &master_time, &slave_time);
+    bench_keep(master_time);
+    bench_keep(slave_time);
+}
+
+static void
+tsproc_delay_op(void* arg)
+{
+    struct tsproc_ctx* c = arg;
+    tmv_t delay;
+
+    c->now += 1000000000ULL;
+    tsproc_up_ts(c->tsp,
+                 nanoseconds_to_tmv(c->now),
+                 nanoseconds_to_tmv(c->now + BENCH_DELAY - BENCH_OFFSET + noise[c->n++ % NUM_INPUTS]));
+    tsproc_update_delay(c->tsp, &delay);
+    bench_keep(delay.ns);
+}
+
+static void
+tsproc_offset_op(void* arg)
+{
+    struct tsproc_ctx* c = arg;
+    tmv_t offset;
+    double weight;
+
+    c->now += 1000000000ULL;
+    tsproc_down_ts(c->tsp,
+                   nanoseconds_to_tmv(c->now),
+                   nanoseconds_to_tmv(c->now + BENCH_DELAY + BENCH_OFFSET + noise[c->n++ % NUM_INPUTS]));
+    tsproc_update_offset(c->tsp, &offset, &weight);
+    bench_keep(offset.ns);
+}
+
+static void
+filter_op(void* arg)
+{
+    struct filter_ctx* c = arg;
+    tmv_t out;
+
+    out = filter_sample(c->filter, nanoseconds_to_tmv(BENCH_DELAY + noise[c->n++ % NUM_INPUTS]));
+    bench_keep(out.ns);
+}
+
+static void
+outlier_op(void* arg)
+{
+    struct outlier_ctx* c = arg;
+
+    bench_keep(outlier_sample(c->outlier, nanoseconds_to_tmv(BENCH_DELAY + noise[c->n++ % NUM_INPUTS])) > 0.0);
+}
+
+/* Same calls as a locked stable sample with phase offload in main.c. */
+static void
+offload_op(void* arg)
+{
+    struct offload_ctx* c = arg;
+
+    actuator_set_freq(BENCH_PHC, BENCH_FREQ);
+    actuator_set_phase(BENCH_PHC, BENCH_OFFSET + noise[c->n++ % NUM_INPUTS]);
+}
+
+static void
+hdrhist_op(void* arg)
+{
+    struct hdrhist_ctx* c = arg;
+
+    hdrhist_record(&c->hist, BENCH_DELAY + noise[c->n++ % NUM_INPUTS]);
+}
+
+static void
+servo_op(void* arg)
+{
+    struct servo_ctx* c = arg;
+    enum servo_state state;
+    double adj;
+
+    c->local_ts += 1000000000ULL;
+    adj = servo_sample(c->servo, BENCH_OFFSET + noise[c->n++ % NUM_INPUTS], c->local_ts, 1.0, &state);
+    bench_keep(adj);
+}
+
+/* Same steps as clock_update() and path_delay() in main.c. */
+static void
+pipeline_op(void* arg)
+{
+    struct pipeline_ctx* c = arg;
+    int64_t master_time, slave_time, offset;
+    enum servo_state state;
+    tmv_t master_offset, delay;
+    uint16_t tlv_type;
+    double weight, adj;
+    uint8_t* msg;
+
+    msg = c->msgs[c->n / 2 % NUM_INPUTS][c->n % 2];
+    c->n++;
+    process_message(msg, &tlv_type, &master_time, &slave_time);
+    if (tlv_type == SLAVE_DELAY_TIMING_DATA_NP) {
+        tsproc_up_ts(c->tsp, nanoseconds_to_tmv(slave_time), nanoseconds_to_tmv(master_time));
+        tsproc_update_delay(c->tsp, &delay);
+        return;
+    }
+    tsproc_down_ts(c->tsp, nanoseconds_to_tmv(master_time), nanoseconds_to_tmv(slave_time));
+    if (tsproc_update_offset(c->tsp, &master_offset, &weight)) {
+        return;
+    }
+    offset = tmv_to_nanoseconds(master_offset);
+    adj = servo_sample(c->servo, offset, slave_time, weight, &state);
+    tsproc_set_clock_rate_ratio(c->tsp, servo_rate_ratio(c->servo));
+    switch (state) {
+    case SERVO_UNLOCKED:
+        break;
+    case SERVO_JUMP:
+        clockadj_set_freq(CLOCK_REALTIME, -adj);
+        clockadj_step(CLOCK_REALTIME, -offset);
+        tsproc_reset(c->tsp, 0);
+        break;
+    case SERVO_LOCKED:
+    case SERVO_LOCKED_STABLE:
+        clockadj_set_freq(CLOCK_REALTIME, -adj);
+        break;
+    }
+}
+
+static void
+bench_hdrhist()
+{
+    struct hdrhist_ctx* c = calloc(1, sizeof(*c));
+
+    hdrhist_reset(&c->hist);
+    bench_run("hdrhist_record", "", hdrhist_op, c);
+    bench_keep(hdrhist_quantile(&c->hist, 0.99));
+    free(c);
+}
+
+static struct servo*
+create_servo(enum servo_type type)
+{
+    struct servo_config cfg;
+    struct servo* servo;
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.type = type;
+    cfg.max_frequency = 900000000;
+    cfg.kp_exponent = -0.3;
+    cfg.kp_norm_max = 0.7;
+    cfg.ki_exponent = 0.4;
+    cfg.ki_norm_max = 0.3;
+    servo = servo_create(&cfg);
+    if (servo) {
+        servo_sync_interval(servo, 1.0);
+    }
+    return servo;
+}
+
+static void
+bench_msg(const char* variant)
+{
+    struct msg_ctx c;
+
+    memset(&c, 0, sizeof(c));
+    bench_build_sync_msg(c.msgs[0], 1, 1000000000ULL, 1000005100ULL);
+    bench_build_delay_msg(c.msgs[1], 1, 1000100000ULL, 1000104900ULL);
+    bench_run("process_message", variant, msg_op, &c);
+}
+
+static void
+bench_tsproc(const char* variant)
+{
+    struct tsproc_ctx c;
+
+    memset(&c, 0, sizeof(c));
+    c.tsp = tsproc_create(TSPROC_FILTER, FILTER_MOVING_MEDIAN, 10);
+    c.now = 1000000000ULL;
+    tsproc_down_ts(c.tsp, nanoseconds_to_tmv(c.now), nanoseconds_to_tmv(c.now + BENCH_DELAY + BENCH_OFFSET));
+    bench_run("tsproc_update_delay", variant, tsproc_delay_op, &c);
+    bench_run("tsproc_update_offset", variant, tsproc_offset_op, &c);
+    tsproc_destroy(c.tsp);
+}
+
+static void
+bench_filters(void)
+{
+    static const struct
+    {
+        const char* name;
+        enum filter_type type;
+    } types[] = {
+        { "moving_average", FILTER_MOVING_AVERAGE },
+        { "moving_median", FILTER_MOVING_MEDIAN },
+        { "exp_average", FILTER_EXP_AVERAGE },
+    };
+    static const int lengths[] = { 3, 10, 15, 64, 256 };
+    struct filter_ctx c;
+    char variant[64];
+    unsigned int i, j;
+
+    for (i = 0; i < COUNTOF(types); i++) {
+        for (j = 0; j < COUNTOF(lengths); j++) {
+            memset(&c, 0, sizeof(c));
+            c.filter = filter_create(types[i].type, lengths[j]);
+            if (!c.filter) {
+                continue;
+            }
+            snprintf(variant, sizeof(variant), "%s/%d", types[i].name, lengths[j]);
+            bench_run("filter_sample", variant, filter_op, &c);
+            filter_destroy(c.filter);
+        }
+    }
+}
+
+/*
+ * The sorted window is updated with two memmoves of up to the window length,
+ * so the cost grows linearly with it. The longest configurable window shows
+ * the upper bound of that cost.
+ */
+static void
+bench_outlier(void)
+{
+    static const int lengths[] = { OUTLIER_DEFAULT_LENGTH, 256, 1024 };
+    struct outlier_ctx c;
+    char variant[64];
+    unsigned int i;
+
+    for (i = 0; i < COUNTOF(lengths); i++) {
+        memset(&c, 0, sizeof(c));
+        c.outlier = outlier_create(OUTLIER_MODE_REJECT, lengths[i], 0.0, 1);
+        if (!c.outlier) {
+            continue;
+        }
+        snprintf(variant, sizeof(variant), "reject/%d", lengths[i]);
+        bench_run("outlier_sample", variant, outlier_op, &c);
+        outlier_destroy(c.outlier);
+    }
+}
+
+static void
+bench_servos(void)
+{
+    static const struct
+    {
+        const char* name;
+        enum servo_type type;
+    } types[] = {
+        { "pi", PI_SERVO },
+        { "linreg", LINEAR_REG },
+    };
+    struct servo_ctx c;
+    unsigned int i;
+
+    for (i = 0; i < COUNTOF(types); i++) {
+        memset(&c, 0, sizeof(c));
+        c.servo = create_servo(types[i].type);
+        if (!c.servo) {
+            continue;
+        }
+        c.local_ts = 1000000000ULL;
+        bench_run("servo_sample", types[i].name, servo_op, &c);
+        servo_destroy(c.servo);
+    }
+}
+
+/*
+ * While the device removes the phase the frequency stays put, so each
+ * sample must cost one clock_adjtime() for the phase and none for the
+ * unchanged frequency word.
+ */
+static void
+bench_offload(void)
+{
+    struct offload_ctx c;
+    unsigned long calls;
+
+    memset(&c, 0, sizeof(c));
+    offload_op(&c);
+    calls = clockadj_stub_calls;
+    c.n = 0;
+    bench_run("phase_offload", "", offload_op, &c);
+    calls = clockadj_stub_calls - calls;
+    if (calls != c.n) {
+        fprintf(stderr, "phase_offload: %lu clock adjustments for %u samples\n", calls, c.n);
+        adjust_failures++;
+    }
+}
+
+static void
+bench_pipeline(const char* variant)
+{
+    struct pipeline_ctx* c;
+    unsigned long n;
+    uint64_t t;
+    int i;
+
+    c = calloc(1, sizeof(*c));
+    if (!c) {
+        return;
+    }
+    c->tsp = tsproc_create(TSPROC_FILTER, FILTER_MOVING_MEDIAN, 10);
+    c->servo = create_servo(PI_SERVO);
+    for (i = 0; i < NUM_INPUTS; i++) {
+        t = (i + 1) * 1000000000ULL;
+        bench_build_delay_msg(c->msgs[i][0], i, t, t + BENCH_DELAY - BENCH_OFFSET + noise[i]);
+        bench_build_sync_msg(c->msgs[i][1], i, t + 500000000ULL, t + 500000000ULL + BENCH_DELAY + BENCH_OFFSET);
+    }
+    n = allocs;
+    bench_run("sample_pipeline", variant, pipeline_op, c);
+    if (allocs != n) {
+        fprintf(stderr, "sample_pipeline/%s: %lu heap allocations\n", variant, allocs - n);
+        alloc_failures++;
+    }
+    servo_destroy(c->servo);
+    tsproc_destroy(c->tsp);
+    free(c);
+}
+
+int
+main(int argc, char** argv)
+{
+    int i;
+
+    srand(1);
+    for (i = 0; i < NUM_INPUTS; i++) {
+        noise[i] = rand() % 200 - 100;
+    }
+
+    set_log_level(LOG_INFO);
+    bench_msg("log6");
+    bench_tsproc("log6");
+    bench_filters();
+    bench_outlier();
+    bench_servos();
+    bench_offload();
+    bench_hdrhist();
+    bench_pipeline("log6");
+
+    /* Debug level formats every message even with no output enabled. */
+    set_log_level(LOG_DEBUG);
+    bench_msg("log7");
+    bench_tsproc("log7");
+    bench_pipeline("log7");
+
+    /*
+     * Debug level through the trace rings. The drain thread cannot keep up
+     * with a tight loop, so part of the records take the ring full path.
+     */
+    trace_start(1 << 16);
+    trace_register();
+    bench_msg("log7/trace");
+    bench_tsproc("log7/trace");
+    bench_pipeline("log7/trace");
+    trace_stop();
+
+    return alloc_failures || adjust_failures ? 1 : 0;
+}
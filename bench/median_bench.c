@@ -0,0 +1,87 @@
+/**
+ * @file median_bench.c
+ * @brief Compares the generic moving median with the fixed length kernels.
+ * @note Copyright (C) 2022 SyncMonk Technologies <services@syncmonk.net>
+ * @note SPDX-License-Identifier: GPL-2.0+
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "filter.h"
+#include "mmedian.h"
+#include "mmedian_fixed.h"
+
+#define NUM_INPUTS 4096
+
+static tmv_t inputs[NUM_INPUTS];
+
+struct median_ctx
+{
+    struct filter* filter;
+    unsigned int n;
+};
+
+static void
+median_op(void* arg)
+{
+    struct median_ctx* c = arg;
+    tmv_t out;
+
+    out = filter_sample(c->filter, inputs[c->n++ % NUM_INPUTS]);
+    bench_keep(out.ns);
+}
+
+static int
+check(struct filter* generic, struct filter* fixed)
+{
+    int i;
+
+    filter_reset(generic);
+    filter_reset(fixed);
+    for (i = 0; i < NUM_INPUTS; i++) {
+        if (tmv_cmp(filter_sample(generic, inputs[i]), filter_sample(fixed, inputs[i]))) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int
+main(int argc, char** argv)
+{
+    static const int lengths[] = { 3, 5, 7, 9, 15 };
+    struct median_ctx generic, fixed;
+    char variant[32];
+    unsigned int i;
+    int rv = 0;
+
+    srand(1);
+    for (i = 0; i < NUM_INPUTS; i++) {
+        inputs[i].ns = 10000 + rand() % 2000;
+    }
+
+    for (i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+        memset(&generic, 0, sizeof(generic));
+        memset(&fixed, 0, sizeof(fixed));
+        generic.filter = mmedian_create(lengths[i]);
+        fixed.filter = mmedian_fixed_create(lengths[i]);
+        if (!generic.filter || !fixed.filter) {
+            fprintf(stderr, "failed to create filters of length %d\n", lengths[i]);
+            return 1;
+        }
+        if (check(generic.filter, fixed.filter)) {
+            fprintf(stderr, "median mismatch for length %d\n", lengths[i]);
+            rv = 1;
+        }
+        snprintf(variant, sizeof(variant), "generic/%d", lengths[i]);
+        bench_run("median_filter", variant, median_op, &generic);
+        snprintf(variant, sizeof(variant), "fixed/%d", lengths[i]);
+        bench_run("median_filter", variant, median_op, &fixed);
+        filter_destroy(generic.filter);
+        filter_destroy(fixed.filter);
+    }
+    return rv;
+}
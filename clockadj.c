@@ -4,10 +4,13 @@
  * @note SPDX-License-Identifier: GPL-2.0+
  */
 
+#define LOG_SUBSYS LOG_SUBSYS_CLOCKADJ
+
 #include <errno.h>
 #include <math.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/ioctl.h>
 #include <linux/ptp_clock.h>
 #include <sys/timex.h>
 #include <time.h>
@@ -15,7 +18,10 @@
 
 #include "clockadj.h"
 #include "logger.h"
+#include "metrics.h"
 #include "missing.h"
+#include "probes.h"
+#include "trace.h"
 
 #define NS_PER_SEC 1000000000LL
 
@@ -38,24 +44,62 @@ clockadj_init(clockid_t clkid)
 #endif
 }
 
-void
-clockadj_set_freq(clockid_t clkid, double freq)
+/* Frequency part of a clock_adjtime() call. */
+static void
+freq_timex(clockid_t clkid, double freq, struct timex* tx)
 {
-    struct timex tx;
-    memset(&tx, 0, sizeof(tx));
-    pr_debug("%s freq: %f", __func__, freq);
-
     /* With system clock set also the tick length. */
     if (clkid == CLOCK_REALTIME && realtime_nominal_tick) {
-        tx.modes |= ADJ_TICK;
-        tx.tick = round(freq / 1e3 / realtime_hz) + realtime_nominal_tick;
-        freq -= 1e3 * realtime_hz * (tx.tick - realtime_nominal_tick);
+        tx->modes |= ADJ_TICK;
+        tx->tick = round(freq / 1e3 / realtime_hz) + realtime_nominal_tick;
+        freq -= 1e3 * realtime_hz * (tx->tick - realtime_nominal_tick);
     }
 
-    tx.modes |= ADJ_FREQUENCY;
-    tx.freq = (long)(freq * 65.536);
-    if (clock_adjtime(clkid, &tx) < 0)
+    tx->modes |= ADJ_FREQUENCY;
+    tx->freq = clockadj_freq_word(freq);
+}
+
+/* Step part of a clock_adjtime() call. */
+static void
+step_timex(int64_t step, struct timex* tx)
+{
+    int sign = 1;
+
+    if (step < 0) {
+        sign = -1;
+        step *= -1;
+    }
+    tx->modes |= ADJ_SETOFFSET | ADJ_NANO;
+    tx->time.tv_sec = sign * (step / NS_PER_SEC);
+    tx->time.tv_usec = sign * (step % NS_PER_SEC);
+    /*
+     * The value of a timeval is the sum of its fields, but the
+     * field tv_usec must always be non-negative.
+     */
+    if (tx->time.tv_usec < 0) {
+        tx->time.tv_sec -= 1;
+        tx->time.tv_usec += 1000000000;
+    }
+}
+
+int
+clockadj_set_freq(clockid_t clkid, double freq)
+{
+    struct timex tx;
+    int rc;
+
+    memset(&tx, 0, sizeof(tx));
+    trace_debug("%s freq: %f", __func__, freq);
+
+    freq_timex(clkid, freq, &tx);
+    rc = clock_adjtime(clkid, &tx);
+    PROBE3(set_freq, clkid, (int64_t)(freq * 1e3), rc);
+    if (rc < 0) {
+        metrics_inc(adjtime_errors);
         pr_err("failed to adjust the clock: %m");
+        return -1;
+    }
+    return 0;
 }
 
 double
@@ -75,43 +119,81 @@ clockadj_get_freq(clockid_t clkid)
     return f;
 }
 
-void
+int
 clockadj_set_phase(clockid_t clkid, long offset)
 {
     struct timex tx;
+    int rc;
+
     memset(&tx, 0, sizeof(tx));
     tx.modes = ADJ_OFFSET | ADJ_NANO;
     tx.offset = offset;
-    if (clock_adjtime(clkid, &tx) < 0) {
+    rc = clock_adjtime(clkid, &tx);
+    PROBE3(set_phase, clkid, offset, rc);
+    if (rc < 0) {
+        metrics_inc(adjtime_errors);
         pr_err("failed to set the clock offset: %m");
+        return -1;
     }
+    return 0;
 }
 
-void
+int
 clockadj_step(clockid_t clkid, int64_t step)
 {
     struct timex tx;
-    int sign = 1;
-    if (step < 0) {
-        sign = -1;
-        step *= -1;
-    }
+    int rc;
 
     pr_debug("%s : %ld", __func__, step);
     memset(&tx, 0, sizeof(tx));
-    tx.modes = ADJ_SETOFFSET | ADJ_NANO;
-    tx.time.tv_sec = sign * (step / NS_PER_SEC);
-    tx.time.tv_usec = sign * (step % NS_PER_SEC);
-    /*
-     * The value of a timeval is the sum of its fields, but the
-     * field tv_usec must always be non-negative.
-     */
-    if (tx.time.tv_usec < 0) {
-        tx.time.tv_sec -= 1;
-        tx.time.tv_usec += 1000000000;
+    step_timex(step, &tx);
+    rc = clock_adjtime(clkid, &tx);
+    PROBE3(step, clkid, step, rc);
+    if (rc < 0) {
+        metrics_inc(adjtime_errors);
+        pr_err("failed to step clock: %m");
+        return -1;
     }
-    if (clock_adjtime(clkid, &tx) < 0)
+    return 0;
+}
+
+int
+clockadj_step_freq(clockid_t clkid, int64_t step, double freq)
+{
+    struct timex tx;
+    int rc;
+
+    pr_debug("%s : %ld freq: %f", __func__, step, freq);
+    memset(&tx, 0, sizeof(tx));
+    /* The kernel applies the offset first, then the frequency. */
+    step_timex(step, &tx);
+    freq_timex(clkid, freq, &tx);
+    rc = clock_adjtime(clkid, &tx);
+    PROBE3(step, clkid, step, rc);
+    PROBE3(set_freq, clkid, (int64_t)(freq * 1e3), rc);
+    if (rc < 0) {
+        metrics_inc(adjtime_errors);
         pr_err("failed to step clock: %m");
+        return -1;
+    }
+    return 0;
+}
+
+int
+clockadj_max_phase(clockid_t clkid)
+{
+    struct ptp_clock_caps caps;
+
+    if (clkid == CLOCK_REALTIME) {
+        return 0;
+    }
+    memset(&caps, 0, sizeof(caps));
+    if (ioctl(CLOCKID_TO_FD(clkid), PTP_CLOCK_GETCAPS, &caps)) {
+        pr_err("failed to read out the clock capabilities: %m");
+        return 0;
+    }
+    /* Drivers before max_phase_adj leave the field zero. */
+    return caps.adjust_phase ? caps.max_phase_adj : 0;
 }
 
 int
@@ -221,6 +303,8 @@ sysclk_set_sync(void)
        to avoid getting the STA_UNSYNC flag back. */
     tx.modes = ADJ_STATUS | ADJ_MAXERROR;
     tx.status = realtime_leap_bit;
-    if (clock_adjtime(clkid, &tx) < 0)
+    if (clock_adjtime(clkid, &tx) < 0) {
+        metrics_inc(adjtime_errors);
         pr_err("failed to set clock status and maximum error: %m");
+    }
 }
@@ -18,12 +18,24 @@
 void
 clockadj_init(clockid_t clkid);
 
+/**
+ * Frequency word written to the clock for a frequency offset.
+ * @param freq  The frequency offset in parts per billion (ppb).
+ * @return      The frequency offset in units of 2^-16 ppm, see struct timex.
+ */
+static inline long
+clockadj_freq_word(double freq)
+{
+    return (long)(freq * 65.536);
+}
+
 /**
  * Set clock's frequency offset.
  * @param clkid A clock ID obtained using phc_open() or CLOCK_REALTIME.
  * @param freq  The frequency offset in parts per billion (ppb).
+ * @return      Zero on success, -1 on failure.
  */
-void
+int
 clockadj_set_freq(clockid_t clkid, double freq);
 
 /**
@@ -38,18 +50,41 @@ clockadj_get_freq(clockid_t clkid);
  * Set clock's phase offset.
  * @param clkid  A clock ID obtained using phc_open() or CLOCK_REALTIME.
  * @param offset The phase offset in nanoseconds.
+ * @return       Zero on success, -1 on failure.
  */
-void
+int
 clockadj_set_phase(clockid_t clkid, long offset);
 
 /**
  * Step clock's time.
  * @param clkid A clock ID obtained using phc_open() or CLOCK_REALTIME.
  * @param step  The time step in nanoseconds.
+ * @return      Zero on success, -1 on failure.
  */
-void
+int
 clockadj_step(clockid_t clkid, int64_t step);
 
+/**
+ * Step clock's time and set its frequency offset in one call.
+ * Only CLOCK_REALTIME applies both, a PHC ignores the frequency.
+ * @param clkid CLOCK_REALTIME.
+ * @param step  The time step in nanoseconds.
+ * @param freq  The frequency offset in parts per billion (ppb).
+ * @return      Zero on success, -1 on failure.
+ */
+int
+clockadj_step_freq(clockid_t clkid, int64_t step, double freq);
+
+/**
+ * Read maximum phase adjustment of a PHC which corrects the phase in
+ * hardware, see clockadj_set_phase().
+ * @param clkid A clock ID obtained using phc_open().
+ * @return      The maximum phase adjustment in nanoseconds, zero if the
+ *              clock has none or does not advertise its limit.
+ */
+int
+clockadj_max_phase(clockid_t clkid);
+
 /**
  * Read maximum frequency adjustment of the target clock.
  * @return The maximum frequency adjustment in parts per billion (ppb).
@@ -28,6 +28,35 @@ static struct key_val tsproc_types[] = { { "filter", FILTER },
 static struct key_val delay_filters[] = {
     { "moving_average", AVERAGE },
     { "moving_median", MEDIAN },
+    { "exp_average", EXP_AVERAGE },
+};
+
+static struct key_val outlier_filters[] = {
+    { "none", OUTLIER_NONE },
+    { "reject", OUTLIER_REJECT },
+    { "weight", OUTLIER_WEIGHT },
+};
+
+static struct key_val receive_modes[] = {
+    { "poll", RECEIVE_POLL },
+    { "busy_poll", RECEIVE_BUSY_POLL },
+};
+
+static struct key_val tod_syncs[] = {
+    { "none", TOD_SYNC_NONE },
+    { "freq_device", TOD_SYNC_FREQ_DEVICE },
+    { "system", TOD_SYNC_SYSTEM },
+};
+
+static struct key_val actuation_modes[] = {
+    { "inline", ACTUATION_INLINE },
+    { "pipelined", ACTUATION_PIPELINED },
+};
+
+static struct key_val sched_policies[] = {
+    { "other", SCHED_POLICY_OTHER },
+    { "fifo", SCHED_POLICY_FIFO },
+    { "rr", SCHED_POLICY_RR },
 };
 
 static struct field_info logger_tbl[] = {
@@ -65,6 +94,76 @@ static struct field_info logger_tbl[] = {
       .max = 1,
       .def = 1,
     },
+    /* trace_ring_size */
+    {
+      .field_name = "trace_ring_size",
+      .idx = TRACE_RING_SIZE,
+      .var_type = VAR_TYPE_INTEGER,
+      .min = 0,
+      .max = 1 << 20,
+      .def = 0,
+    },
+    /* log_file */
+    {
+      .field_name = "log_file",
+      .idx = LOG_FILE,
+      .var_type = VAR_TYPE_STRING,
+      .default_str = "",
+    },
+    /* log_file_max_size */
+    {
+      .field_name = "log_file_max_size",
+      .idx = LOG_FILE_MAX_SIZE,
+      .var_type = VAR_TYPE_INTEGER,
+      .min = 0,
+      .max = UINT32_MAX,
+      .def = 0,
+    },
+    /* log_file_rotations */
+    {
+      .field_name = "log_file_rotations",
+      .idx = LOG_FILE_ROTATIONS,
+      .var_type = VAR_TYPE_INTEGER,
+      .min = 1,
+      .max = 99,
+      .def = 1,
+    },
+    /* msg_level */
+    {
+      .field_name = "msg_level",
+      .idx = MSG_LEVEL,
+      .var_type = VAR_TYPE_INTEGER,
+      .min = 0,
+      .max = 7,
+      .def = LOG_LEVEL_UNSET,
+    },
+    /* tsproc_level */
+    {
+      .field_name = "tsproc_level",
+      .idx = TSPROC_LEVEL,
+      .var_type = VAR_TYPE_INTEGER,
+      .min = 0,
+      .max = 7,
+      .def = LOG_LEVEL_UNSET,
+    },
+    /* servo_level */
+    {
+      .field_name = "servo_level",
+      .idx = SERVO_LEVEL,
+      .var_type = VAR_TYPE_INTEGER,
+      .min = 0,
+      .max = 7,
+      .def = LOG_LEVEL_UNSET,
+    },
+    /* clockadj_level */
+    {
+      .field_name = "clockadj_level",
+      .idx = CLOCKADJ_LEVEL,
+      .var_type = VAR_TYPE_INTEGER,
+      .min = 0,
+      .max = 7,
+      .def = LOG_LEVEL_UNSET,
+    },
 };
 
 static struct field_info servo_config_tbl[] = {
@@ -277,6 +376,289 @@ static struct field_info device_tbl[] = {
       .max = INT_MAX,
       .def = 10,
     },
+    /* delay_filter_time_constant */
+    {
+      .field_name = "delay_filter_time_constant",
+      .idx = FILTER_TIME_CONSTANT,
+      .var_type = VAR_TYPE_DOUBLE,
+      .min = 0.0,
+      .max = DBL_MAX,
+      .def = 0.0,
+    },
+    /* outlier_filter */
+    {
+      .field_name = "outlier_filter",
+      .idx = OUTLIER_FILTER,
+      .var_type = VAR_TYPE_ENUM,
+      .enum_list = outlier_filters,
+      .enum_sz = COUNTOF(outlier_filters),
+    },
+    /* outlier_filter_length */
+    {
+      .field_name = "outlier_filter_length",
+      .idx = OUTLIER_FILTER_LEN,
+      .var_type = VAR_TYPE_INTEGER,
+      .min = 3,
+      .max = 1024,
+      .def = 31,
+    },
+    /* outlier_threshold */
+    {
+      .field_name = "outlier_threshold",
+      .idx = OUTLIER_THRESHOLD,
+      .var_type = VAR_TYPE_DOUBLE,
+      .min = 0.0,
+      .max = DBL_MAX,
+      .def = 5.0,
+    },
+    /* outlier_min_mad */
+    {
+      .field_name = "outlier_min_mad",
+      .idx = OUTLIER_MIN_MAD,
+      .var_type = VAR_TYPE_INTEGER,
+      .min = 0,
+      .max = INT_MAX,
+      .def = 0,
+    },
+    /* receive_mode */
+    {
+      .field_name = "receive_mode",
+      .idx = RECEIVE_MODE,
+      .var_type = VAR_TYPE_ENUM,
+      .enum_list = receive_modes,
+      .enum_sz = COUNTOF(receive_modes),
+    },
+    /* busy_poll_idle */
+    {
+      .field_name = "busy_poll_idle",
+      .idx = BUSY_POLL_IDLE,
+      .var_type = VAR_TYPE_INTEGER,
+      .min = 0,
+      .max = INT_MAX,
+      .def = 0,
+    },
+    /* busy_poll_pause */
+    {
+      .field_name = "busy_poll_pause",
+      .idx = BUSY_POLL_PAUSE,
+      .var_type = VAR_TYPE_INTEGER,
+      .min = 0,
+      .max = 1024,
+      .def = 0,
+    },
+    /* actuation_mode */
+    {
+      .field_name = "actuation_mode",
+      .idx = ACTUATION_MODE,
+      .var_type = VAR_TYPE_ENUM,
+      .enum_list = actuation_modes,
+      .enum_sz = COUNTOF(actuation_modes),
+    },
+    /* freq_dither */
+    {
+      .field_name = "freq_dither",
+      .idx = FREQ_DITHER,
+      .var_type = VAR_TYPE_INTEGER,
+      .min = 0,
+      .max = 1,
+      .def = 0,
+    },
+    /* freq_resolution */
+    {
+      .field_name = "freq_resolution",
+      .idx = FREQ_RESOLUTION,
+      .var_type = VAR_TYPE_DOUBLE,
+      .min = 0.0,
+      .max = 1000.0,
+      .def = 0.0,
+    },
+    /* Follower devices. */
+    {
+      .field_name = "follower_devices",
+      .idx = FOLLOWER_DEVICES,
+      .var_type = VAR_TYPE_STRING,
+    },
+    /* tod_sync */
+    {
+      .field_name = "tod_sync",
+      .idx = TOD_SYNC,
+      .var_type = VAR_TYPE_ENUM,
+      .enum_list = tod_syncs,
+      .enum_sz = COUNTOF(tod_syncs),
+    },
+    /* tod_sync_interval */
+    {
+      .field_name = "tod_sync_interval",
+      .idx = TOD_SYNC_INTERVAL,
+      .var_type = VAR_TYPE_INTEGER,
+      .min = 0,
+      .max = 60000,
+      .def = 0,
+    },
+    /* tod_sync_readings */
+    {
+      .field_name = "tod_sync_readings",
+      .idx = TOD_SYNC_READINGS,
+      .var_type = VAR_TYPE_INTEGER,
+      .min = 0,
+      .max = 25,
+      .def = 0,
+    },
+    /* phase_offload */
+    {
+      .field_name = "phase_offload",
+      .idx = PHASE_OFFLOAD,
+      .var_type = VAR_TYPE_INTEGER,
+      .min = 0,
+      .max = 1,
+      .def = 0,
+    },
+    /* actuation_compensation */
+    {
+      .field_name = "actuation_compensation",
+      .idx = ACTUATION_COMPENSATION,
+      .var_type = VAR_TYPE_INTEGER,
+      .min = 0,
+      .max = 1,
+      .def = 0,
+    },
+};
+
+static struct field_info metrics_tbl[] = {
+    /* metrics_uds_address */
+    {
+      .field_name = "uds_address",
+      .idx = METRICS_UDS_ADDRESS,
+      .var_type = VAR_TYPE_STRING,
+      .default_str = "",
+    },
+    /* metrics_tcp_address */
+    {
+      .field_name = "tcp_address",
+      .idx = METRICS_TCP_ADDRESS,
+      .var_type = VAR_TYPE_STRING,
+      .default_str = "127.0.0.1",
+    },
+    /* metrics_tcp_port */
+    {
+      .field_name = "tcp_port",
+      .idx = METRICS_TCP_PORT,
+      .var_type = VAR_TYPE_INTEGER,
+      .min = 0,
+      .max = UINT16_MAX,
+      .def = 0,
+    },
+    /* metrics_instance */
+    {
+      .field_name = "instance",
+      .idx = METRICS_INSTANCE,
+      .var_type = VAR_TYPE_STRING,
+      .default_str = "",
+    },
+    /* metrics_histogram_interval */
+    {
+      .field_name = "histogram_interval",
+      .idx = METRICS_HISTOGRAM_INTERVAL,
+      .var_type = VAR_TYPE_INTEGER,
+      .min = 0,
+      .max = 604800,
+      .def = 3600,
+    },
+    /* metrics_telemetry_file */
+    {
+      .field_name = "telemetry_file",
+      .idx = METRICS_TELEMETRY_FILE,
+      .var_type = VAR_TYPE_STRING,
+      .default_str = "",
+    },
+    /* metrics_telemetry_records */
+    {
+      .field_name = "telemetry_records",
+      .idx = METRICS_TELEMETRY_RECORDS,
+      .var_type = VAR_TYPE_INTEGER,
+      .min = 0,
+      .max = 1 << 24,
+      .def = 65536,
+    },
+    /* metrics_status_shm */
+    {
+      .field_name = "status_shm",
+      .idx = METRICS_STATUS_SHM,
+      .var_type = VAR_TYPE_STRING,
+      .default_str = "",
+    },
+};
+
+static struct field_info runtime_tbl[] = {
+    /* runtime_sched_policy */
+    {
+      .field_name = "sched_policy",
+      .idx = RUNTIME_SCHED_POLICY,
+      .var_type = VAR_TYPE_ENUM,
+      .enum_list = sched_policies,
+      .enum_sz = COUNTOF(sched_policies),
+    },
+    /* runtime_sched_priority */
+    {
+      .field_name = "sched_priority",
+      .idx = RUNTIME_SCHED_PRIORITY,
+      .var_type = VAR_TYPE_INTEGER,
+      .min = 1,
+      .max = 99,
+      .def = 50,
+    },
+    /* runtime_cpu_affinity */
+    {
+      .field_name = "cpu_affinity",
+      .idx = RUNTIME_CPU_AFFINITY,
+      .var_type = VAR_TYPE_STRING,
+      .default_str = "",
+    },
+    /* runtime_mlock */
+    {
+      .field_name = "mlock",
+      .idx = RUNTIME_MLOCK,
+      .var_type = VAR_TYPE_INTEGER,
+      .min = 0,
+      .max = 1,
+      .def = 0,
+    },
+    /* runtime_prefault_stack */
+    {
+      .field_name = "prefault_stack",
+      .idx = RUNTIME_PREFAULT_STACK,
+      .var_type = VAR_TYPE_INTEGER,
+      .min = 0,
+      .max = 8192,
+      .def = 256,
+    },
+    /* runtime_prefault_heap */
+    {
+      .field_name = "prefault_heap",
+      .idx = RUNTIME_PREFAULT_HEAP,
+      .var_type = VAR_TYPE_INTEGER,
+      .min = 0,
+      .max = 1 << 20,
+      .def = 4096,
+    },
+    /* runtime_irq */
+    {
+      .field_name = "irq",
+      .idx = RUNTIME_IRQ,
+      .var_type = VAR_TYPE_INTEGER,
+      .min = 0,
+      .max = INT_MAX,
+      .def = 0,
+    },
+    /* runtime_strict */
+    {
+      .field_name = "strict",
+      .idx = RUNTIME_STRICT,
+      .var_type = VAR_TYPE_INTEGER,
+      .min = 0,
+      .max = 1,
+      .def = 0,
+    },
 };
 
 /* external servo parse state. */
@@ -288,6 +670,8 @@ enum servo_parser_state
     START_SERVO_BLOCK,
     START_DEVICE_BLOCK,
     START_LOGGER_BLOCK,
+    START_METRICS_BLOCK,
+    START_RUNTIME_BLOCK,
 };
 
 /**
@@ -309,6 +693,8 @@ struct servo_parser_data
         struct logger_config logger_config;
         struct device_config device_config;
         struct servo_config servo_config;
+        struct metrics_config metrics_config;
+        struct runtime_config runtime_config;
     } config;
 };
 
@@ -455,6 +841,30 @@ update_logger_config(struct logger_config* config, char* key, char* key_value)
     case USE_STDOUT:
         config->use_stdout = value;
         break;
+    case TRACE_RING_SIZE:
+        config->trace_ring_size = value;
+        break;
+    case LOG_FILE:
+        strncpy(config->log_file, key_value, MAX_LOG_FILE_LEN - 1);
+        break;
+    case LOG_FILE_MAX_SIZE:
+        config->log_file_max_size = value;
+        break;
+    case LOG_FILE_ROTATIONS:
+        config->log_file_rotations = value;
+        break;
+    case MSG_LEVEL:
+        config->msg_level = value;
+        break;
+    case TSPROC_LEVEL:
+        config->tsproc_level = value;
+        break;
+    case SERVO_LEVEL:
+        config->servo_level = value;
+        break;
+    case CLOCKADJ_LEVEL:
+        config->clockadj_level = value;
+        break;
     default:
         pr_err("Logging: Undefined field: %s", key);
         break;
@@ -545,8 +955,10 @@ update_servo_config(struct servo_config* config, char* key, char* key_val)
         config->ntpshm_segment = value;
         break;
     case LOGMIN_DELAY_REQ_INTERVAL:
+        config->logMinDelayReqInterval = value;
         break;
     case LOG_SYNC_INTERVAL:
+        config->logSyncInterval = value;
         break;
     default:
         pr_err("Servo: Undefined field: %s", key);
@@ -610,6 +1022,57 @@ update_device_config(struct device_config* config, char* key, char* key_val)
     case FILTER_LEN:
         config->filter_len = value;
         break;
+    case FILTER_TIME_CONSTANT:
+        config->filter_time_constant = value;
+        break;
+    case OUTLIER_FILTER:
+        config->outlier_filter = value;
+        break;
+    case OUTLIER_FILTER_LEN:
+        config->outlier_filter_len = value;
+        break;
+    case OUTLIER_THRESHOLD:
+        config->outlier_threshold = value;
+        break;
+    case OUTLIER_MIN_MAD:
+        config->outlier_min_mad = value;
+        break;
+    case RECEIVE_MODE:
+        config->receive_mode = value;
+        break;
+    case BUSY_POLL_IDLE:
+        config->busy_poll_idle = value;
+        break;
+    case BUSY_POLL_PAUSE:
+        config->busy_poll_pause = value;
+        break;
+    case ACTUATION_MODE:
+        config->actuation_mode = value;
+        break;
+    case FREQ_DITHER:
+        config->freq_dither = value;
+        break;
+    case FREQ_RESOLUTION:
+        config->freq_resolution = value;
+        break;
+    case FOLLOWER_DEVICES:
+        strncpy(config->follower_devices, key_val, MAX_CONFIG_LIST_LEN - 1);
+        break;
+    case TOD_SYNC:
+        config->tod_sync = value;
+        break;
+    case TOD_SYNC_INTERVAL:
+        config->tod_sync_interval = value;
+        break;
+    case TOD_SYNC_READINGS:
+        config->tod_sync_readings = value;
+        break;
+    case PHASE_OFFLOAD:
+        config->phase_offload = value;
+        break;
+    case ACTUATION_COMPENSATION:
+        config->actuation_compensation = value;
+        break;
     default:
         pr_err("Device config: Undefined field: %s", key);
         break;
@@ -617,6 +1080,132 @@ update_device_config(struct device_config* config, char* key, char* key_val)
     return 0;
 }
 
+/**
+ * @brief Update metrics configuration.
+ *
+ * @param [in] config metrics config.
+ * @param [in] key  Key for metrics config.
+ * @param [in] key_value Key Value for metrics config.
+ *
+ * @return -1 Key not find the metrics Config block.
+ *            Key value not in range.
+ * @return 0 Success.
+ */
+static int
+update_metrics_config(struct metrics_config* config, char* key, char* key_val)
+{
+    struct field_info* field_info;
+    int rv;
+    double value;
+
+    pr_info("%s: %s", key, key_val);
+    field_info = get_field_info(key, metrics_tbl, sizeof(metrics_tbl) / sizeof(struct field_info));
+    if (field_info == NULL) {
+        pr_err("Error in getting field info in Metrics Block ");
+        return -1;
+    }
+
+    rv = value_range_check(field_info, key_val, &value);
+    if (rv == -1) {
+        pr_err("Value range check failed for key %s: data: %s", key, key_val);
+        return -1;
+    }
+
+    switch (field_info->idx) {
+    case METRICS_UDS_ADDRESS:
+        strncpy(config->uds_address, key_val, MAX_CONFIG_STR_LEN - 1);
+        break;
+    case METRICS_TCP_ADDRESS:
+        strncpy(config->tcp_address, key_val, MAX_CONFIG_STR_LEN - 1);
+        break;
+    case METRICS_TCP_PORT:
+        config->tcp_port = value;
+        break;
+    case METRICS_INSTANCE:
+        strncpy(config->instance, key_val, MAX_CONFIG_STR_LEN - 1);
+        break;
+    case METRICS_HISTOGRAM_INTERVAL:
+        config->histogram_interval = value;
+        break;
+    case METRICS_TELEMETRY_FILE:
+        strncpy(config->telemetry_file, key_val, MAX_CONFIG_STR_LEN - 1);
+        break;
+    case METRICS_TELEMETRY_RECORDS:
+        config->telemetry_records = value;
+        break;
+    case METRICS_STATUS_SHM:
+        strncpy(config->status_shm, key_val, MAX_CONFIG_STR_LEN - 1);
+        break;
+    default:
+        pr_err("Metrics config: Undefined field: %s", key);
+        break;
+    }
+    return 0;
+}
+
+/**
+ * @brief Update runtime configuration.
+ *
+ * @param [in] config runtime config.
+ * @param [in] key  Key for runtime config.
+ * @param [in] key_value Key Value for runtime config.
+ *
+ * @return -1 Key not find the runtime Config block.
+ *            Key value not in range.
+ * @return 0 Success.
+ */
+static int
+update_runtime_config(struct runtime_config* config, char* key, char* key_val)
+{
+    struct field_info* field_info;
+    int rv;
+    double value;
+
+    pr_info("%s: %s", key, key_val);
+    field_info = get_field_info(key, runtime_tbl, sizeof(runtime_tbl) / sizeof(struct field_info));
+    if (field_info == NULL) {
+        pr_err("Error in getting field info in Runtime Block ");
+        return -1;
+    }
+
+    rv = value_range_check(field_info, key_val, &value);
+    if (rv == -1) {
+        pr_err("Value range check failed for key %s: data: %s", key, key_val);
+        return -1;
+    }
+
+    switch (field_info->idx) {
+    case RUNTIME_SCHED_POLICY:
+        config->sched_policy = value;
+        break;
+    case RUNTIME_SCHED_PRIORITY:
+        config->sched_priority = value;
+        break;
+    case RUNTIME_CPU_AFFINITY:
+        strncpy(config->cpu_affinity, key_val, MAX_CONFIG_STR_LEN - 1);
+        break;
+    case RUNTIME_MLOCK:
+        config->mlock = value;
+        break;
+    case RUNTIME_PREFAULT_STACK:
+        config->prefault_stack = value;
+        break;
+    case RUNTIME_PREFAULT_HEAP:
+        config->prefault_heap = value;
+        break;
+    case RUNTIME_IRQ:
+        config->irq = value;
+        break;
+    case RUNTIME_STRICT:
+        config->strict = value;
+        break;
+    default:
+        pr_err("Runtime config: Undefined field: %s", key);
+        break;
+    }
+    return 0;
+}
+
 /**
  * @brief update configuration to device database.
  *
@@ -639,6 +1228,14 @@ servo_update_config(struct servo_parser_data* data)
         device_configure(&data->config.device_config);
         pr_debug("device configuration done for device.");
         break;
+    case START_METRICS_BLOCK:
+        metrics_configure(&data->config.metrics_config);
+        pr_debug("metrics configuration done.");
+        break;
+    case START_RUNTIME_BLOCK:
+        runtime_configure(&data->config.runtime_config);
+        pr_debug("runtime configuration done.");
+        break;
     default:
         pr_err("Undefined parser state: %d", data->state);
         break;
@@ -669,6 +1266,12 @@ servo_prepare_config(struct servo_parser_data* data)
     case START_SERVO_BLOCK:
         rv = update_servo_config(&data->config.servo_config, data->key, data->val);
         break;
+    case START_METRICS_BLOCK:
+        rv = update_metrics_config(&data->config.metrics_config, data->key, data->val);
+        break;
+    case START_RUNTIME_BLOCK:
+        rv = update_runtime_config(&data->config.runtime_config, data->key, data->val);
+        break;
     default:
         break;
     }
@@ -756,6 +1359,10 @@ parser_block_management(struct servo_parser_data* data, yaml_token_t* token)
         value = data->key;
         if (!strcmp(value, "logging")) {
             memset(&data->config.logger_config, 0, sizeof(struct logger_config));
+            data->config.logger_config.msg_level = LOG_LEVEL_UNSET;
+            data->config.logger_config.tsproc_level = LOG_LEVEL_UNSET;
+            data->config.logger_config.servo_level = LOG_LEVEL_UNSET;
+            data->config.logger_config.clockadj_level = LOG_LEVEL_UNSET;
             data->state = START_LOGGER_BLOCK;
             pr_info("[Logger configuration]");
         } else if (!strcmp(value, "servo")) {
@@ -766,6 +1373,14 @@ parser_block_management(struct servo_parser_data* data, yaml_token_t* token)
             memset(&data->config.device_config, 0, sizeof(struct device_config));
             data->state = START_DEVICE_BLOCK;
             pr_info("[Device configuration]");
+        } else if (!strcmp(value, "metrics")) {
+            memset(&data->config.metrics_config, 0, sizeof(struct metrics_config));
+            data->state = START_METRICS_BLOCK;
+            pr_info("[Metrics configuration]");
+        } else if (!strcmp(value, "runtime")) {
+            memset(&data->config.runtime_config, 0, sizeof(struct runtime_config));
+            data->state = START_RUNTIME_BLOCK;
+            pr_info("[Runtime configuration]");
         } else {
             return 0;
         }
@@ -822,6 +1437,8 @@ servo_config_parser(struct servo_parser_data* data, yaml_token_t* token)
     case START_DEVICE_BLOCK:
     case START_SERVO_BLOCK:
     case START_LOGGER_BLOCK:
+    case START_METRICS_BLOCK:
+    case START_RUNTIME_BLOCK:
         return update_block_config(data, token);
     default:
         break;
@@ -82,6 +82,14 @@ parse_config_file(char* filename);
 #define USE_SYSLOG 1
 #define MESSAGE_TAG 2
 #define USE_STDOUT 3
+#define TRACE_RING_SIZE 4
+#define LOG_FILE 5
+#define LOG_FILE_MAX_SIZE 6
+#define LOG_FILE_ROTATIONS 7
+#define MSG_LEVEL 8
+#define TSPROC_LEVEL 9
+#define SERVO_LEVEL 10
+#define CLOCKADJ_LEVEL 11
 /** @} */
 
 /**
@@ -122,10 +130,58 @@ parse_config_file(char* filename);
 #define TSPROC_MODE 4
 #define DELAY_FILTER 5
 #define FILTER_LEN 6
+#define OUTLIER_FILTER 7
+#define OUTLIER_FILTER_LEN 8
+#define OUTLIER_THRESHOLD 9
+#define OUTLIER_MIN_MAD 10
+#define FILTER_TIME_CONSTANT 11
+#define RECEIVE_MODE 12
+#define BUSY_POLL_IDLE 13
+#define BUSY_POLL_PAUSE 14
+#define ACTUATION_MODE 15
+#define FREQ_DITHER 16
+#define FREQ_RESOLUTION 17
+#define FOLLOWER_DEVICES 18
+#define TOD_SYNC 19
+#define TOD_SYNC_INTERVAL 20
+#define TOD_SYNC_READINGS 21
+#define PHASE_OFFLOAD 22
+#define ACTUATION_COMPENSATION 23
+/** @} */
+
+/**
+ * @defgroup METRICS config.
+ *
+ * @{
+ */
+#define METRICS_UDS_ADDRESS 0
+#define METRICS_TCP_ADDRESS 1
+#define METRICS_TCP_PORT 2
+#define METRICS_INSTANCE 3
+#define METRICS_HISTOGRAM_INTERVAL 4
+#define METRICS_TELEMETRY_FILE 5
+#define METRICS_TELEMETRY_RECORDS 6
+#define METRICS_STATUS_SHM 7
+/** @} */
+
+/**
+ * @defgroup RUNTIME config.
+ *
+ * @{
+ */
+#define RUNTIME_SCHED_POLICY 0
+#define RUNTIME_SCHED_PRIORITY 1
+#define RUNTIME_CPU_AFFINITY 2
+#define RUNTIME_MLOCK 3
+#define RUNTIME_PREFAULT_STACK 4
+#define RUNTIME_PREFAULT_HEAP 5
+#define RUNTIME_IRQ 6
+#define RUNTIME_STRICT 7
 /** @} */
 
 #define MAX_MSG_TAG_LEN 16
 #define MAX_CONFIG_STR_LEN 32
+#define MAX_CONFIG_LIST_LEN 256
 /**
  * @brief Available Servo types.
  *
@@ -148,7 +204,41 @@ enum tsproc_type
 enum delay_filter
 {
     AVERAGE,
-    MEDIAN
+    MEDIAN,
+    EXP_AVERAGE,
+};
+
+enum outlier_filter
+{
+    OUTLIER_NONE,
+    OUTLIER_REJECT,
+    OUTLIER_WEIGHT,
+};
+
+enum receive_mode
+{
+    RECEIVE_POLL,
+    RECEIVE_BUSY_POLL,
+};
+
+enum tod_sync
+{
+    TOD_SYNC_NONE,
+    TOD_SYNC_FREQ_DEVICE,
+    TOD_SYNC_SYSTEM,
+};
+
+enum actuation_mode
+{
+    ACTUATION_INLINE,
+    ACTUATION_PIPELINED,
+};
+
+enum sched_policy
+{
+    SCHED_POLICY_OTHER,
+    SCHED_POLICY_FIFO,
+    SCHED_POLICY_RR,
 };
 
 struct servo_config
@@ -188,7 +278,74 @@ struct device_config
     uint16_t poll_time;
     enum delay_filter filter;
     int filter_len;
+    double filter_time_constant;
     enum tsproc_type mode;
+    enum outlier_filter outlier_filter;
+    int outlier_filter_len;
+    double outlier_threshold;
+    int outlier_min_mad;
+    enum receive_mode receive_mode;
+    /* Time without datagrams before busy polling falls back to poll() [us], 0 for the default. */
+    uint32_t busy_poll_idle;
+    /* pause instructions between two empty receive attempts. */
+    uint16_t busy_poll_pause;
+    /* Clock adjustments inline or on the actuation thread. */
+    enum actuation_mode actuation_mode;
+    /* Carry the frequency quantization error from one write to the next. */
+    uint8_t freq_dither;
+    /* Frequency step of the frequency and follower devices [ppb], required with freq_dither. */
+    double freq_resolution;
+    /* Comma separated devices which follow the frequency of freq_device. */
+    char follower_devices[MAX_CONFIG_LIST_LEN];
+    /* Reference the TOD device is kept on by a loop of its own. */
+    enum tod_sync tod_sync;
+    /* Interval of the TOD loop [ms], 0 for the default. */
+    uint32_t tod_sync_interval;
+    /* Readings per cross timestamp, 0 for the default. */
+    int tod_sync_readings;
+    /* Correct the phase in hardware once the servo is stable, if supported. */
+    uint8_t phase_offload;
+    /* Measure the actuation delay and compensate for it in the servo. */
+    uint8_t actuation_compensation;
+};
+
+struct metrics_config
+{
+    /* Path of the UNIX stream socket, empty to disable. */
+    char uds_address[MAX_CONFIG_STR_LEN];
+    /* Local address of the TCP socket, defaults to 127.0.0.1. */
+    char tcp_address[MAX_CONFIG_STR_LEN];
+    /* TCP port, 0 to disable. */
+    uint16_t tcp_port;
+    /* Value of the instance label, defaults to the message tag. */
+    char instance[MAX_CONFIG_STR_LEN];
+    /* Rotation interval of the histograms in seconds, 0 for one hour. */
+    uint32_t histogram_interval;
+    /* Memory mapped per sample ring, empty to disable. */
+    char telemetry_file[MAX_CONFIG_STR_LEN];
+    /* Records in the ring, 0 for the default. */
+    uint32_t telemetry_records;
+    /* POSIX shared memory name of the status page, empty to disable. */
+    char status_shm[MAX_CONFIG_STR_LEN];
+};
+
+struct runtime_config
+{
+    /* Scheduling class of the sample path. */
+    enum sched_policy sched_policy;
+    /* Real time priority, 0 for the default. */
+    int sched_priority;
+    /* CPU list, e.g. "2" or "2,3" or "2-3", empty to keep the inherited mask. */
+    char cpu_affinity[MAX_CONFIG_STR_LEN];
+    /* Lock all current and future pages. */
+    uint8_t mlock;
+    /* Stack and heap prefaulted with mlock [kB], 0 for the default. */
+    uint32_t prefault_stack;
+    uint32_t prefault_heap;
+    /* IRQ steered to cpu_affinity together with its thread, 0 to disable. */
+    int irq;
+    /* Exit if any part of the profile cannot be applied. */
+    uint8_t strict;
 };
 
 extern int
@@ -199,4 +356,10 @@ device_configure(struct device_config* config);
 
 extern void
 servo_configure(struct servo_config* config);
+
+extern void
+metrics_configure(struct metrics_config* config);
+
+extern void
+runtime_configure(struct runtime_config* config);
 #endif /*! __CONFIG_H__*/
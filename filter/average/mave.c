@@ -7,6 +7,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "arena.h"
 #include "utils.h"
 #include "tmv.h"
 #include "mave.h"
@@ -26,8 +27,8 @@ static void
 mave_destroy(struct filter* filter)
 {
     struct mave* m = container_of(filter, struct mave, filter);
-    free(m->val);
-    free(m);
+    arena_free(m->val);
+    arena_free(m);
 }
 
 static tmv_t
@@ -60,16 +61,16 @@ struct filter*
 mave_create(int length)
 {
     struct mave* m;
-    m = calloc(1, sizeof(*m));
+    m = arena_calloc(1, sizeof(*m));
     if (!m) {
         return NULL;
     }
     m->filter.destroy = mave_destroy;
     m->filter.sample = mave_accumulate;
     m->filter.reset = mave_reset;
-    m->val = calloc(1, length * sizeof(*m->val));
+    m->val = arena_calloc(1, length * sizeof(*m->val));
     if (!m->val) {
-        free(m);
+        arena_free(m);
         return NULL;
     }
     m->len = length;
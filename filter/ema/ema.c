@@ -0,0 +1,72 @@
+/**
+ * @file ema.c
+ * @brief Exponential moving average (first order IIR) filter.
+ * @note Copyright (C) 2022 SyncMonk Technologies <services@syncmonk.net>
+ * @note SPDX-License-Identifier: GPL-2.0+
+ */
+
+#include <stdlib.h>
+
+#include "arena.h"
+#include "utils.h"
+#include "tmv.h"
+#include "ema.h"
+#include "filter.h"
+
+struct ema
+{
+    struct filter filter;
+    int cnt;
+    int len;
+    double mean;
+};
+
+static void
+ema_destroy(struct filter* filter)
+{
+    struct ema* e = container_of(filter, struct ema, filter);
+    arena_free(e);
+}
+
+static tmv_t
+ema_sample(struct filter* filter, tmv_t sample)
+{
+    struct ema* e = container_of(filter, struct ema, filter);
+
+    /*
+     * Until the filter has seen length samples it behaves as a cumulative
+     * average, after that the smoothing factor stays at 1 / length.
+     */
+    if (e->cnt < e->len) {
+        e->cnt++;
+    }
+    e->mean += (tmv_dbl(sample) - e->mean) / e->cnt;
+
+    return dbl_tmv(e->mean);
+}
+
+static void
+ema_reset(struct filter* filter)
+{
+    struct ema* e = container_of(filter, struct ema, filter);
+
+    e->cnt = 0;
+    e->mean = 0.0;
+}
+
+struct filter*
+ema_create(int length)
+{
+    struct ema* e;
+
+    if (length < 1 || length > FILTER_EXP_AVERAGE_MAX_LENGTH)
+        return NULL;
+    e = arena_calloc(1, sizeof(*e));
+    if (!e)
+        return NULL;
+    e->filter.destroy = ema_destroy;
+    e->filter.sample = ema_sample;
+    e->filter.reset = ema_reset;
+    e->len = length;
+    return &e->filter;
+}
@@ -0,0 +1,15 @@
+/**
+ * @file ema.h
+ * @note Copyright (C) 2022 SyncMonk Technologies <services@syncmonk.net>
+ * @note SPDX-License-Identifier: GPL-2.0+
+ */
+
+#ifndef __EMA_H__
+#define __EMA_H__
+
+#include "filter.h"
+
+struct filter*
+ema_create(int length);
+
+#endif /* __EMA_H__ */
@@ -5,18 +5,28 @@
  */
  
 #include "filter.h"
+#include "ema.h"
 #include "mave.h"
 #include "mmedian.h"
+#include "mmedian_fixed.h"
 #include "tmv.h"
 
 struct filter*
 filter_create(enum filter_type type, int length)
 {
+    struct filter* filter;
+
     switch (type) {
     case FILTER_MOVING_AVERAGE:
         return mave_create(length);
     case FILTER_MOVING_MEDIAN:
-        return mmedian_create(length);
+        /* Prefer a fixed length kernel, the generic filter is the fallback. */
+        filter = mmedian_fixed_create(length);
+        if (!filter)
+            filter = mmedian_create(length);
+        return filter;
+    case FILTER_EXP_AVERAGE:
+        return ema_create(length);
     default:
         return NULL;
     }
@@ -21,12 +21,17 @@ enum filter_type
 {
     FILTER_MOVING_AVERAGE,
     FILTER_MOVING_MEDIAN,
+    FILTER_EXP_AVERAGE,
 };
 
+/** Longest time constant of FILTER_EXP_AVERAGE, a weight of 2^-24 per sample. */
+#define FILTER_EXP_AVERAGE_MAX_LENGTH (1 << 24)
+
 /**
  * Create a new instance of a filter.
  * @param type    The type of the filter to create.
- * @param length  The filter's length.
+ * @param length  The filter's length. For FILTER_EXP_AVERAGE this is the
+ *                time constant in samples.
  * @return A pointer to a new filter on success, NULL otherwise.
  */
 struct filter*
@@ -7,6 +7,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "arena.h"
 #include "utils.h"
 #include "tmv.h"
 #include "mmedian.h"
@@ -28,9 +29,9 @@ static void
 mmedian_destroy(struct filter* filter)
 {
     struct mmedian* m = container_of(filter, struct mmedian, filter);
-    free(m->order);
-    free(m->samples);
-    free(m);
+    arena_free(m->order);
+    arena_free(m->samples);
+    arena_free(m);
 }
 
 static tmv_t
@@ -82,21 +83,21 @@ mmedian_create(int length)
 
     if (length < 1)
         return NULL;
-    m = calloc(1, sizeof(*m));
+    m = arena_calloc(1, sizeof(*m));
     if (!m)
         return NULL;
     m->filter.destroy = mmedian_destroy;
     m->filter.sample = mmedian_sample;
     m->filter.reset = mmedian_reset;
-    m->order = calloc(1, length * sizeof(*m->order));
+    m->order = arena_calloc(1, length * sizeof(*m->order));
     if (!m->order) {
-        free(m);
+        arena_free(m);
         return NULL;
     }
-    m->samples = calloc(1, length * sizeof(*m->samples));
+    m->samples = arena_calloc(1, length * sizeof(*m->samples));
     if (!m->samples) {
-        free(m->order);
-        free(m);
+        arena_free(m->order);
+        arena_free(m);
         return NULL;
     }
     m->len = length;
@@ -0,0 +1,176 @@
+/**
+ * @file mmedian_fixed.c
+ * @brief Moving median filters specialized for short fixed windows.
+ * @note Copyright (C) 2022 SyncMonk Technologies <services@syncmonk.net>
+ * @note SPDX-License-Identifier: GPL-2.0+
+ *
+ * Each specialization keeps the samples in a ring of compile-time length
+ * and runs a copy of the ring through a fixed comparator network made of
+ * branchless min/max pairs. For short windows this is much cheaper than
+ * maintaining the order[] index of the generic filter.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "utils.h"
+#include "tmv.h"
+#include "mmedian_fixed.h"
+#include "filter.h"
+
+#define MMEDIAN_FIXED_MAX 15
+
+struct mmedian_fixed
+{
+    struct filter filter;
+    int cnt;
+    int index;
+    /* Values stored in circular buffer. */
+    int64_t samples[MMEDIAN_FIXED_MAX];
+};
+
+#define CMP_SWAP(a, b)                                                                                                 \
+    do {                                                                                                               \
+        int64_t __lo = (a) < (b) ? (a) : (b);                                                                          \
+        int64_t __hi = (a) < (b) ? (b) : (a);                                                                          \
+        (a) = __lo;                                                                                                    \
+        (b) = __hi;                                                                                                    \
+    } while (0)
+
+/*
+ * Batcher odd-even merge sorting networks, pruned to the comparators that
+ * affect the middle output.
+ */
+#define MEDIAN_NETWORK_3(v)                                                                                            \
+    CMP_SWAP(v[0], v[1]); CMP_SWAP(v[0], v[2]); CMP_SWAP(v[1], v[2]);
+
+#define MEDIAN_NETWORK_5(v)                                                                                            \
+    CMP_SWAP(v[0], v[1]); CMP_SWAP(v[2], v[3]); CMP_SWAP(v[0], v[2]); CMP_SWAP(v[1], v[3]);                            \
+    CMP_SWAP(v[1], v[2]); CMP_SWAP(v[0], v[4]); CMP_SWAP(v[2], v[4]); CMP_SWAP(v[1], v[2]);
+
+#define MEDIAN_NETWORK_7(v)                                                                                            \
+    CMP_SWAP(v[0], v[1]); CMP_SWAP(v[2], v[3]); CMP_SWAP(v[4], v[5]); CMP_SWAP(v[0], v[2]);                            \
+    CMP_SWAP(v[1], v[3]); CMP_SWAP(v[4], v[6]); CMP_SWAP(v[1], v[2]); CMP_SWAP(v[5], v[6]);                            \
+    CMP_SWAP(v[0], v[4]); CMP_SWAP(v[1], v[5]); CMP_SWAP(v[2], v[6]); CMP_SWAP(v[2], v[4]);                            \
+    CMP_SWAP(v[3], v[5]); CMP_SWAP(v[3], v[4]);
+
+#define MEDIAN_NETWORK_9(v)                                                                                            \
+    CMP_SWAP(v[0], v[1]); CMP_SWAP(v[2], v[3]); CMP_SWAP(v[4], v[5]); CMP_SWAP(v[6], v[7]);                            \
+    CMP_SWAP(v[0], v[2]); CMP_SWAP(v[1], v[3]); CMP_SWAP(v[4], v[6]); CMP_SWAP(v[5], v[7]);                            \
+    CMP_SWAP(v[1], v[2]); CMP_SWAP(v[5], v[6]); CMP_SWAP(v[0], v[4]); CMP_SWAP(v[1], v[5]);                            \
+    CMP_SWAP(v[2], v[6]); CMP_SWAP(v[3], v[7]); CMP_SWAP(v[2], v[4]); CMP_SWAP(v[3], v[5]);                            \
+    CMP_SWAP(v[1], v[2]); CMP_SWAP(v[3], v[4]); CMP_SWAP(v[5], v[6]); CMP_SWAP(v[0], v[8]);                            \
+    CMP_SWAP(v[4], v[8]); CMP_SWAP(v[2], v[4]); CMP_SWAP(v[3], v[5]); CMP_SWAP(v[3], v[4]);
+
+#define MEDIAN_NETWORK_15(v)                                                                                           \
+    CMP_SWAP(v[0], v[1]); CMP_SWAP(v[2], v[3]); CMP_SWAP(v[4], v[5]); CMP_SWAP(v[6], v[7]);                            \
+    CMP_SWAP(v[8], v[9]); CMP_SWAP(v[10], v[11]); CMP_SWAP(v[12], v[13]); CMP_SWAP(v[0], v[2]);                        \
+    CMP_SWAP(v[1], v[3]); CMP_SWAP(v[4], v[6]); CMP_SWAP(v[5], v[7]); CMP_SWAP(v[8], v[10]);                           \
+    CMP_SWAP(v[9], v[11]); CMP_SWAP(v[12], v[14]); CMP_SWAP(v[1], v[2]); CMP_SWAP(v[5], v[6]);                         \
+    CMP_SWAP(v[9], v[10]); CMP_SWAP(v[13], v[14]); CMP_SWAP(v[0], v[4]); CMP_SWAP(v[1], v[5]);                         \
+    CMP_SWAP(v[2], v[6]); CMP_SWAP(v[3], v[7]); CMP_SWAP(v[8], v[12]); CMP_SWAP(v[9], v[13]);                          \
+    CMP_SWAP(v[10], v[14]); CMP_SWAP(v[2], v[4]); CMP_SWAP(v[3], v[5]); CMP_SWAP(v[10], v[12]);                        \
+    CMP_SWAP(v[11], v[13]); CMP_SWAP(v[1], v[2]); CMP_SWAP(v[3], v[4]); CMP_SWAP(v[5], v[6]);                          \
+    CMP_SWAP(v[9], v[10]); CMP_SWAP(v[11], v[12]); CMP_SWAP(v[13], v[14]); CMP_SWAP(v[0], v[8]);                       \
+    CMP_SWAP(v[1], v[9]); CMP_SWAP(v[2], v[10]); CMP_SWAP(v[3], v[11]); CMP_SWAP(v[4], v[12]);                         \
+    CMP_SWAP(v[5], v[13]); CMP_SWAP(v[6], v[14]); CMP_SWAP(v[4], v[8]); CMP_SWAP(v[5], v[9]);                          \
+    CMP_SWAP(v[6], v[10]); CMP_SWAP(v[7], v[11]); CMP_SWAP(v[6], v[8]); CMP_SWAP(v[7], v[9]);                          \
+    CMP_SWAP(v[7], v[8]);
+
+/* Median of a partially filled window, as computed by the generic filter. */
+static tmv_t
+partial_median(struct mmedian_fixed* m)
+{
+    int64_t v[MMEDIAN_FIXED_MAX], x;
+    tmv_t a, b;
+    int i, j;
+
+    for (i = 0; i < m->cnt; i++) {
+        x = m->samples[i];
+        for (j = i; j > 0 && v[j - 1] > x; j--)
+            v[j] = v[j - 1];
+        v[j] = x;
+    }
+    if (m->cnt % 2)
+        return nanoseconds_to_tmv(v[m->cnt / 2]);
+
+    a = nanoseconds_to_tmv(v[m->cnt / 2 - 1]);
+    b = nanoseconds_to_tmv(v[m->cnt / 2]);
+    return tmv_div(tmv_add(a, b), 2);
+}
+
+static void
+mmedian_fixed_destroy(struct filter* filter)
+{
+    struct mmedian_fixed* m = container_of(filter, struct mmedian_fixed, filter);
+    arena_free(m);
+}
+
+static void
+mmedian_fixed_reset(struct filter* filter)
+{
+    struct mmedian_fixed* m = container_of(filter, struct mmedian_fixed, filter);
+    m->cnt = 0;
+    m->index = 0;
+}
+
+#define MMEDIAN_FIXED(N)                                                                                               \
+    static tmv_t mmedian##N##_sample(struct filter* filter, tmv_t sample)                                              \
+    {                                                                                                                  \
+        struct mmedian_fixed* m = container_of(filter, struct mmedian_fixed, filter);                                  \
+        int64_t v[N];                                                                                                  \
+                                                                                                                       \
+        m->samples[m->index] = tmv_to_nanoseconds(sample);                                                             \
+        m->index = (1 + m->index) % N;                                                                                 \
+                                                                                                                       \
+        if (m->cnt < N) {                                                                                              \
+            m->cnt++;                                                                                                  \
+            if (m->cnt < N)                                                                                            \
+                return partial_median(m);                                                                              \
+        }                                                                                                              \
+                                                                                                                       \
+        memcpy(v, m->samples, sizeof(v));                                                                              \
+        MEDIAN_NETWORK_##N(v);                                                                                         \
+        return nanoseconds_to_tmv(v[N / 2]);                                                                           \
+    }
+
+MMEDIAN_FIXED(3)
+MMEDIAN_FIXED(5)
+MMEDIAN_FIXED(7)
+MMEDIAN_FIXED(9)
+MMEDIAN_FIXED(15)
+
+struct filter*
+mmedian_fixed_create(int length)
+{
+    tmv_t (*sample)(struct filter * filter, tmv_t sample);
+    struct mmedian_fixed* m;
+
+    switch (length) {
+    case 3:
+        sample = mmedian3_sample;
+        break;
+    case 5:
+        sample = mmedian5_sample;
+        break;
+    case 7:
+        sample = mmedian7_sample;
+        break;
+    case 9:
+        sample = mmedian9_sample;
+        break;
+    case 15:
+        sample = mmedian15_sample;
+        break;
+    default:
+        return NULL;
+    }
+
+    m = arena_calloc(1, sizeof(*m));
+    if (!m)
+        return NULL;
+    m->filter.destroy = mmedian_fixed_destroy;
+    m->filter.sample = sample;
+    m->filter.reset = mmedian_fixed_reset;
+    return &m->filter;
+}
@@ -0,0 +1,21 @@
+/**
+ * @file mmedian_fixed.h
+ * @note Copyright (C) 2022 SyncMonk Technologies <services@syncmonk.net>
+ * @note SPDX-License-Identifier: GPL-2.0+
+ */
+
+#ifndef __MMEDIAN_FIXED_H__
+#define __MMEDIAN_FIXED_H__
+
+#include "filter.h"
+
+/**
+ * Create a moving median filter specialized for a fixed window length.
+ * @param length  The filter's length.
+ * @return A pointer to a new filter, or NULL when no specialization exists
+ *         for the length (or on allocation failure).
+ */
+struct filter*
+mmedian_fixed_create(int length);
+
+#endif /* __MMEDIAN_FIXED_H__ */
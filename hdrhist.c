@@ -0,0 +1,100 @@
+/**
+ * @file hdrhist.c
+ * @note Copyright (C) 2022 SyncMonk Technologies <services@syncmonk.net>
+ * @note SPDX-License-Identifier: GPL-2.0+
+ */
+
+#include <string.h>
+
+#include "hdrhist.h"
+/******************************************************************************
+ * Public Functions
+ *****************************************************************************/
+void
+hdrhist_reset(struct hdrhist* h)
+{
+    memset(h, 0, sizeof(*h));
+    h->min = UINT64_MAX;
+}
+
+uint64_t
+hdrhist_bucket_max(int index)
+{
+    int e;
+
+    if (index < HDRHIST_SUB_COUNT) {
+        return index;
+    }
+    e = (index >> HDRHIST_SUB_BITS) - 1;
+    return ((((uint64_t)index & (HDRHIST_SUB_COUNT - 1)) | HDRHIST_SUB_COUNT) << e) + (1ULL << e) - 1;
+}
+
+uint64_t
+hdrhist_quantile(const struct hdrhist* h, double quantile)
+{
+    uint64_t rank, seen = 0, v;
+    int i;
+
+    if (!h->count) {
+        return 0;
+    }
+    if (quantile >= 1.0) {
+        return h->max;
+    }
+    rank = quantile <= 0.0 ? 1 : (uint64_t)(quantile * h->count + 0.999999);
+    for (i = 0; i < HDRHIST_BUCKETS; i++) {
+        seen += h->counts[i];
+        if (seen >= rank) {
+            break;
+        }
+    }
+    v = hdrhist_bucket_max(i);
+    return v < h->max ? v : h->max;
+}
+
+void
+hdrhist_merge(struct hdrhist* dst, const struct hdrhist* src)
+{
+    int i;
+
+    for (i = 0; i < HDRHIST_BUCKETS; i++) {
+        dst->counts[i] += src->counts[i];
+    }
+    dst->count += src->count;
+    dst->sum += src->sum;
+    if (src->min < dst->min) {
+        dst->min = src->min;
+    }
+    if (src->max > dst->max) {
+        dst->max = src->max;
+    }
+}
+
+void
+hdrhist_window_init(struct hdrhist_window* w, uint64_t interval_ns, uint64_t now_ns)
+{
+    w->interval_ns = interval_ns;
+    w->start_ns = now_ns;
+    w->complete = 0;
+    hdrhist_reset(&w->cur);
+    hdrhist_reset(&w->last);
+}
+
+void
+hdrhist_window_rotate(struct hdrhist_window* w, uint64_t now_ns)
+{
+    uint64_t elapsed = now_ns - w->start_ns;
+
+    if (elapsed < w->interval_ns) {
+        return;
+    }
+    if (elapsed < 2 * w->interval_ns) {
+        w->last = w->cur;
+    } else {
+        /* No sample at all during the last complete interval. */
+        hdrhist_reset(&w->last);
+    }
+    hdrhist_reset(&w->cur);
+    w->start_ns += elapsed - elapsed % w->interval_ns;
+    w->complete = 1;
+}
@@ -0,0 +1,148 @@
+/**
+ * @file hdrhist.h
+ * @brief Fixed memory log-linear histograms.
+ * @note Copyright (C) 2022 SyncMonk Technologies <services@syncmonk.net>
+ * @note SPDX-License-Identifier: GPL-2.0+
+ *
+ * Values below 2^HDRHIST_SUB_BITS have their own bucket. Above, every
+ * power of 2 range is split into 2^HDRHIST_SUB_BITS linear buckets, so the
+ * relative error of a reported value stays below 1 / 2^HDRHIST_SUB_BITS
+ * (under 1%, 32 ns buckets at a 5 us path delay). Recording is a few shifts
+ * and one increment.
+ */
+
+#ifndef __HDRHIST_H__
+#define __HDRHIST_H__
+
+#include <stdint.h>
+
+#define HDRHIST_SUB_BITS 7
+#define HDRHIST_SUB_COUNT (1 << HDRHIST_SUB_BITS)
+/*! Values of 2^HDRHIST_MAX_BITS (about 73 minutes in ns) and above share the last bucket. */
+#define HDRHIST_MAX_BITS 42
+#define HDRHIST_BUCKETS ((HDRHIST_MAX_BITS - HDRHIST_SUB_BITS + 1) << HDRHIST_SUB_BITS)
+
+struct hdrhist
+{
+    uint64_t count;
+    uint64_t sum;
+    /*! Exact extremes, not rounded to a bucket. */
+    uint64_t min;
+    uint64_t max;
+    uint64_t counts[HDRHIST_BUCKETS];
+};
+
+/**
+ * @brief Histogram over a rotating time interval.
+ *
+ * Samples go to cur. Once the interval has elapsed cur is copied to last,
+ * which stays valid for a whole interval, and cur starts again empty.
+ */
+struct hdrhist_window
+{
+    uint64_t interval_ns;
+    uint64_t start_ns;
+    /*! Set once last holds a complete interval. */
+    int complete;
+    struct hdrhist cur;
+    struct hdrhist last;
+};
+
+static inline int
+hdrhist_index(uint64_t v)
+{
+    int e;
+
+    if (v < HDRHIST_SUB_COUNT) {
+        return v;
+    }
+    if (v >> HDRHIST_MAX_BITS) {
+        return HDRHIST_BUCKETS - 1;
+    }
+    e = 63 - __builtin_clzll(v) - HDRHIST_SUB_BITS;
+    return ((e + 1) << HDRHIST_SUB_BITS) | ((v >> e) & (HDRHIST_SUB_COUNT - 1));
+}
+
+/**
+ * @brief Record one value, constant time.
+ *
+ * @param [in] h Histogram.
+ * @param [in] v Value.
+ */
+static inline void
+hdrhist_record(struct hdrhist* h, uint64_t v)
+{
+    h->counts[hdrhist_index(v)]++;
+    h->count++;
+    h->sum += v;
+    if (v < h->min) {
+        h->min = v;
+    }
+    if (v > h->max) {
+        h->max = v;
+    }
+}
+
+/**
+ * @brief Empty a histogram.
+ *
+ * @param [in] h Histogram.
+ */
+void
+hdrhist_reset(struct hdrhist* h);
+
+/**
+ * @brief Highest value which falls into the same bucket as index.
+ *
+ * @param [in] index Bucket index.
+ * @return Upper bound of the bucket.
+ */
+uint64_t
+hdrhist_bucket_max(int index);
+
+/**
+ * @brief Value at a quantile.
+ *
+ * @param [in] h Histogram.
+ * @param [in] quantile Quantile between 0 and 1.
+ * @return Upper bound of the bucket holding the quantile, capped by the
+ * exact maximum, 0 for an empty histogram.
+ */
+uint64_t
+hdrhist_quantile(const struct hdrhist* h, double quantile);
+
+/**
+ * @brief Add all samples of src to dst.
+ *
+ * @param [in,out] dst Destination histogram.
+ * @param [in] src Source histogram.
+ */
+void
+hdrhist_merge(struct hdrhist* dst, const struct hdrhist* src);
+
+/**
+ * @brief Initialize a window.
+ *
+ * @param [in] w Window.
+ * @param [in] interval_ns Rotation interval in nanoseconds.
+ * @param [in] now_ns Start of the first interval.
+ */
+void
+hdrhist_window_init(struct hdrhist_window* w, uint64_t interval_ns, uint64_t now_ns);
+
+/**
+ * @brief Rotate the window when its interval has elapsed.
+ *
+ * @param [in] w Window.
+ * @param [in] now_ns Current time in the clock given to hdrhist_window_init().
+ */
+void
+hdrhist_window_rotate(struct hdrhist_window* w, uint64_t now_ns);
+
+static inline void
+hdrhist_window_record(struct hdrhist_window* w, uint64_t v)
+{
+    hdrhist_record(&w->cur, v);
+}
+
+#endif /* __HDRHIST_H__ */
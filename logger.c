@@ -4,11 +4,17 @@
  * @note SPDX-License-Identifier: GPL-2.0+
  */
 
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include <syslog.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
 #include <time.h>
 #include <unistd.h>
 
@@ -17,8 +23,253 @@
 /******************************************************************************
  * Local Definitions
  *****************************************************************************/
-static struct logger_config logger_config = { .log_level = 7, .use_syslog = 1, .use_stdout = 1, .msg_tag = "servo" };
-static FILE* log_fp;
+/*! Length of one formatted log line including the prefix. */
+#define LOGGER_LINE_LEN 1100
+/*! Records in the sink queue, must be a power of 2. */
+#define LOGGER_QUEUE_LEN 1024
+/*! Maximum number of records written with one writev(). */
+#define LOGGER_BATCH 64
+/*! Sleep of the sink thread while the queue is empty. */
+#define LOGGER_SINK_INTERVAL_NS 5000000
+
+/**
+ * @brief One formatted log record.
+ *
+ * Slots of the sink queue carry a sequence number, as in Dmitry Vyukov's
+ * bounded MPMC queue. A slot is free for the producer at position pos
+ * when seq == pos and holds a record for the consumer when seq == pos + 1.
+ */
+struct log_record
+{
+    uint64_t seq;
+    int level;
+    /*! Offset of the message text in line, used for syslog(3). */
+    int text;
+    int len;
+    char line[LOGGER_LINE_LEN];
+};
+
+static struct logger_config logger_config = { .log_level = 7,
+                                              .use_syslog = 1,
+                                              .use_stdout = 1,
+                                              .msg_tag = "servo",
+                                              .msg_level = LOG_LEVEL_UNSET,
+                                              .tsproc_level = LOG_LEVEL_UNSET,
+                                              .servo_level = LOG_LEVEL_UNSET,
+                                              .clockadj_level = LOG_LEVEL_UNSET };
+int8_t logger_levels[LOG_SUBSYS_MAX] = { 7, 7, 7, 7, 7 };
+static int log_fd = -1;
+static off_t log_size;
+
+static struct log_record queue[LOGGER_QUEUE_LEN];
+static uint64_t enqueue_pos;
+static uint64_t dequeue_pos;
+static uint64_t dropped;
+static pthread_t sink_thread;
+static int running;
+
+/******************************************************************************
+ * Local Functions
+ *****************************************************************************/
+static void
+format_record(struct log_record* rec, int level, char* msg, struct timespec* ts, const char* text)
+{
+    int n;
+
+    n = snprintf(rec->line,
+                 sizeof(rec->line) - 1,
+                 "[%s][%lld.%03ld]:[%s] ",
+                 logger_config.msg_tag,
+                 (long long)ts->tv_sec,
+                 ts->tv_nsec / 1000000,
+                 msg);
+    rec->text = n;
+    n += snprintf(rec->line + n, sizeof(rec->line) - 1 - n, "%s", text);
+    if (n > (int)sizeof(rec->line) - 2) {
+        n = sizeof(rec->line) - 2;
+    }
+    rec->line[n++] = '\n';
+    rec->line[n] = '\0';
+    rec->len = n;
+    rec->level = level;
+}
+
+static void
+log_file_open()
+{
+    struct stat st;
+
+    log_fd = open(logger_config.log_file, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (log_fd < 0) {
+        return;
+    }
+    log_size = fstat(log_fd, &st) ? 0 : st.st_size;
+}
+
+/* Rename file to file.1, file.1 to file.2 and so on, then reopen file. */
+static void
+log_file_rotate()
+{
+    char from[MAX_LOG_FILE_LEN + 8], to[MAX_LOG_FILE_LEN + 8];
+    int i, keep = logger_config.log_file_rotations ? logger_config.log_file_rotations : 1;
+
+    close(log_fd);
+    for (i = keep; i > 0; i--) {
+        if (i > 1) {
+            snprintf(from, sizeof(from), "%s.%d", logger_config.log_file, i - 1);
+        } else {
+            snprintf(from, sizeof(from), "%s", logger_config.log_file);
+        }
+        snprintf(to, sizeof(to), "%s.%d", logger_config.log_file, i);
+        rename(from, to);
+    }
+    log_file_open();
+}
+
+static void
+write_all(int fd, struct iovec* iov, int cnt)
+{
+    ssize_t n;
+
+    while (cnt > 0) {
+        n = writev(fd, iov, cnt);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        while (cnt > 0 && n >= (ssize_t)iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            cnt--;
+        }
+        if (cnt > 0) {
+            iov->iov_base = (char*)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+}
+
+/* Write a batch of records to every configured destination. */
+static void
+sink_write(struct log_record** recs, int cnt)
+{
+    struct iovec out[LOGGER_BATCH], err[LOGGER_BATCH], file[LOGGER_BATCH];
+    int i, nout = 0, nerr = 0, nfile = 0;
+    size_t bytes = 0;
+
+    for (i = 0; i < cnt; i++) {
+        if (logger_config.use_stdout) {
+            if (recs[i]->level >= LOG_NOTICE) {
+                out[nout++] = (struct iovec){ recs[i]->line, recs[i]->len };
+            } else {
+                err[nerr++] = (struct iovec){ recs[i]->line, recs[i]->len };
+            }
+        }
+        if (log_fd >= 0) {
+            file[nfile++] = (struct iovec){ recs[i]->line, recs[i]->len };
+            bytes += recs[i]->len;
+        }
+        if (logger_config.use_syslog) {
+            syslog(recs[i]->level, "%.*s", recs[i]->len - recs[i]->text - 1, recs[i]->line + recs[i]->text);
+        }
+    }
+
+    write_all(STDOUT_FILENO, out, nout);
+    write_all(STDERR_FILENO, err, nerr);
+    if (nfile) {
+        if (logger_config.log_file_max_size && log_size + bytes > logger_config.log_file_max_size) {
+            log_file_rotate();
+        }
+        if (log_fd >= 0) {
+            write_all(log_fd, file, nfile);
+            log_size += bytes;
+        }
+    }
+}
+
+static int
+enqueue(int level, char* msg, struct timespec* ts, const char* text)
+{
+    uint64_t pos = __atomic_load_n(&enqueue_pos, __ATOMIC_RELAXED);
+    struct log_record* rec;
+    int64_t diff;
+
+    for (;;) {
+        rec = &queue[pos & (LOGGER_QUEUE_LEN - 1)];
+        diff = (int64_t)(__atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE) - pos);
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&enqueue_pos, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            /* Queue full, never wait for the sink. */
+            __atomic_add_fetch(&dropped, 1, __ATOMIC_RELAXED);
+            return -1;
+        } else {
+            pos = __atomic_load_n(&enqueue_pos, __ATOMIC_RELAXED);
+        }
+    }
+
+    format_record(rec, level, msg, ts, text);
+    __atomic_store_n(&rec->seq, pos + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/* Write up to LOGGER_BATCH queued records, returns the number written. */
+static int
+drain_queue()
+{
+    struct log_record* recs[LOGGER_BATCH];
+    struct log_record* rec;
+    struct timespec ts;
+    struct log_record warn;
+    uint64_t lost;
+    int i, cnt = 0;
+
+    while (cnt < LOGGER_BATCH) {
+        rec = &queue[(dequeue_pos + cnt) & (LOGGER_QUEUE_LEN - 1)];
+        if (__atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE) != dequeue_pos + cnt + 1) {
+            break;
+        }
+        recs[cnt++] = rec;
+    }
+    if (cnt) {
+        sink_write(recs, cnt);
+    }
+    for (i = 0; i < cnt; i++) {
+        __atomic_store_n(&recs[i]->seq, dequeue_pos + LOGGER_QUEUE_LEN, __ATOMIC_RELEASE);
+        dequeue_pos++;
+    }
+
+    lost = __atomic_exchange_n(&dropped, 0, __ATOMIC_RELAXED);
+    if (lost) {
+        char text[64];
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        snprintf(text, sizeof(text), "log queue full, %" PRIu64 " messages dropped", lost);
+        format_record(&warn, LOG_WARNING, "WARN", &ts, text);
+        recs[0] = &warn;
+        sink_write(recs, 1);
+    }
+    return cnt;
+}
+
+static void*
+sink_loop(void* arg)
+{
+    struct timespec interval = { 0, LOGGER_SINK_INTERVAL_NS };
+
+    while (__atomic_load_n(&running, __ATOMIC_ACQUIRE)) {
+        if (drain_queue() < LOGGER_BATCH) {
+            nanosleep(&interval, NULL);
+        }
+    }
+    while (drain_queue())
+        ;
+    return NULL;
+}
 
 /******************************************************************************
  * Public Functions
@@ -29,11 +280,6 @@ logger(int level, char* msg, char const* format, ...)
     struct timespec ts;
     va_list args;
     char buffer[1024];
-    FILE* f;
-
-    if (level > logger_config.log_level) {
-        return;
-    }
 
     clock_gettime(CLOCK_MONOTONIC, &ts);
 
@@ -41,28 +287,21 @@ logger(int level, char* msg, char const* format, ...)
     vsnprintf(buffer, sizeof(buffer), format, args);
     va_end(args);
 
-    if (logger_config.use_stdout) {
-        f = level >= LOG_NOTICE ? stdout : stderr;
-        fprintf(f,
-                "[%s][%lld.%03ld]:[%s] %s\n",
-                logger_config.msg_tag ? logger_config.msg_tag : "",
-                (long long)ts.tv_sec,
-                ts.tv_nsec / 1000000,
-                msg,
-                buffer);
-        fflush(f);
-    }
+    logger_write(level, msg, &ts, buffer);
+}
+
+void
+logger_write(int level, char* msg, struct timespec* ts, const char* text)
+{
+    struct log_record rec;
+    struct log_record* recs[1] = { &rec };
 
-    if (logger_config.use_syslog) {
-        fprintf(log_fp,
-                "[%s][%lld.%03ld]:[%s] %s\n",
-                logger_config.msg_tag ? logger_config.msg_tag : "",
-                (long long)ts.tv_sec,
-                ts.tv_nsec / 1000000,
-                msg,
-                buffer);
-        fflush(log_fp);
+    if (__atomic_load_n(&running, __ATOMIC_ACQUIRE)) {
+        enqueue(level, msg, ts, text);
+        return;
     }
+    format_record(&rec, level, msg, ts, text);
+    sink_write(recs, 1);
 }
 
 struct logger_config*
@@ -71,22 +310,67 @@ logger_config_get()
     return &logger_config;
 }
 
+static int8_t
+subsys_level(int8_t level)
+{
+    return level == LOG_LEVEL_UNSET ? logger_config.log_level : level;
+}
+
 int
 logger_configure(struct logger_config* config)
 {
     logger_config = *config;
-    if (!log_fp) {
-        logger_config.use_syslog = 0;
+    logger_levels[LOG_SUBSYS_DEFAULT] = logger_config.log_level;
+    logger_levels[LOG_SUBSYS_MSG] = subsys_level(logger_config.msg_level);
+    logger_levels[LOG_SUBSYS_TSPROC] = subsys_level(logger_config.tsproc_level);
+    logger_levels[LOG_SUBSYS_SERVO] = subsys_level(logger_config.servo_level);
+    logger_levels[LOG_SUBSYS_CLOCKADJ] = subsys_level(logger_config.clockadj_level);
+    if (log_fd >= 0) {
+        close(log_fd);
+        log_fd = -1;
+    }
+    if (strlen(logger_config.log_file)) {
+        log_file_open();
+        if (log_fd < 0) {
+            pr_warning("Log file %s cannot be used: %s", logger_config.log_file, strerror(errno));
+        }
+    }
+    return 0;
+}
+
+int
+logger_start()
+{
+    uint64_t i;
+
+    if (running) {
+        return 0;
+    }
+    for (i = 0; i < LOGGER_QUEUE_LEN; i++) {
+        queue[i].seq = i;
+    }
+    enqueue_pos = dequeue_pos = 0;
+
+    running = 1;
+    if (pthread_create(&sink_thread, NULL, sink_loop, NULL)) {
+        running = 0;
+        return -1;
     }
     return 0;
 }
 
 void
-sys_log_init()
+logger_stop()
 {
-    log_fp = fopen("/var/log/messages", "w");
-    if (log_fp == NULL) {
-        logger_config.use_syslog = 0;
-        pr_warning("System Logging cannot be used.");
+    if (!running) {
+        return;
     }
+    __atomic_store_n(&running, 0, __ATOMIC_RELEASE);
+    pthread_join(sink_thread, NULL);
+}
+
+void
+sys_log_init()
+{
+    openlog(logger_config.msg_tag, LOG_PID | LOG_NDELAY, LOG_DAEMON);
 }
@@ -9,21 +9,71 @@
 
 #include <stdint.h>
 #include <syslog.h>
+#include <time.h>
 
 /*! Maximum message tag length. */
 #define MAX_MSG_TAG_LEN 16
+/*! Maximum log file path length. */
+#define MAX_LOG_FILE_LEN 64
 
 #define LOG_LEVEL_MIN LOG_EMERG
 #define LOG_LEVEL_MAX LOG_DEBUG
 
-#define pr_emerg(...) logger(LOG_EMERG, "EMERG", __VA_ARGS__)
-#define pr_alert(...) logger(LOG_ALERT, "ALERT", __VA_ARGS__)
-#define pr_crit(...) logger(LOG_CRIT, "CRITICAL", __VA_ARGS__)
-#define pr_err(...) logger(LOG_ERR, "ERROR", __VA_ARGS__)
-#define pr_warning(...) logger(LOG_WARNING, "WARN", __VA_ARGS__)
-#define pr_notice(...) logger(LOG_NOTICE, "NOTICE", __VA_ARGS__)
-#define pr_info(...) logger(LOG_INFO, "INFO", __VA_ARGS__)
-#define pr_debug(...) logger(LOG_DEBUG, "DEBUG", __VA_ARGS__)
+/*! Subsystem level not configured, the logging level applies. */
+#define LOG_LEVEL_UNSET -1
+
+/**
+ * Highest level compiled in, statements above it are removed by the
+ * compiler together with their arguments. Set with LOG_COMPILE_LEVEL=n
+ * on the make command line.
+ */
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_DEBUG
+#endif
+
+/**
+ * Subsystems with their own log level. A source file selects its
+ * subsystem by defining LOG_SUBSYS before including any header.
+ */
+enum log_subsys
+{
+    LOG_SUBSYS_DEFAULT,
+    LOG_SUBSYS_MSG,
+    LOG_SUBSYS_TSPROC,
+    LOG_SUBSYS_SERVO,
+    LOG_SUBSYS_CLOCKADJ,
+    LOG_SUBSYS_MAX,
+};
+
+#ifndef LOG_SUBSYS
+#define LOG_SUBSYS LOG_SUBSYS_DEFAULT
+#endif
+
+/*! Effective log level of every subsystem. */
+extern int8_t logger_levels[LOG_SUBSYS_MAX];
+
+/**
+ * True if a message of the given level is logged by the current
+ * subsystem. Checked before the arguments of a message are evaluated.
+ */
+#define logger_enabled(level)                                                                                          \
+    ((level) <= LOG_COMPILE_LEVEL && __builtin_expect((level) <= logger_levels[LOG_SUBSYS], (level) < LOG_INFO))
+
+#define pr_log(level, name, ...)                                                                                       \
+    do {                                                                                                               \
+        if (logger_enabled(level)) {                                                                                   \
+            logger(level, name, __VA_ARGS__);                                                                          \
+        }                                                                                                              \
+    } while (0)
+
+#define pr_emerg(...) pr_log(LOG_EMERG, "EMERG", __VA_ARGS__)
+#define pr_alert(...) pr_log(LOG_ALERT, "ALERT", __VA_ARGS__)
+#define pr_crit(...) pr_log(LOG_CRIT, "CRITICAL", __VA_ARGS__)
+#define pr_err(...) pr_log(LOG_ERR, "ERROR", __VA_ARGS__)
+#define pr_warning(...) pr_log(LOG_WARNING, "WARN", __VA_ARGS__)
+#define pr_notice(...) pr_log(LOG_NOTICE, "NOTICE", __VA_ARGS__)
+#define pr_info(...) pr_log(LOG_INFO, "INFO", __VA_ARGS__)
+#define pr_debug(...) pr_log(LOG_DEBUG, "DEBUG", __VA_ARGS__)
 
 /**
  * @brief servo logging mechanism configuration.
@@ -38,7 +88,7 @@ struct logger_config
      */
     uint8_t log_level;
     /*!
-     * Set to 1 if syslog should be used.
+     * Set to 1 if syslog(3) should be used.
      * Defaults to 0, Valid values are 0 or 1.*/
     uint8_t use_syslog;
     /*! Tag reported in logs. */
@@ -48,6 +98,31 @@ struct logger_config
      * Defaults to 1, Valid values are 0 or 1.
      */
     uint8_t use_stdout;
+    /*!
+     * Records per thread in the binary trace ring, see trace.h.
+     * Defaults to 0, debug messages are then formatted by the caller.
+     */
+    uint32_t trace_ring_size;
+    /*!
+     * Log levels of the msg, tsproc, servo and clockadj subsystems.
+     * Default to LOG_LEVEL_UNSET, the logging level applies.
+     */
+    int8_t msg_level;
+    int8_t tsproc_level;
+    int8_t servo_level;
+    int8_t clockadj_level;
+    /*! Log file, empty to disable. */
+    char log_file[MAX_LOG_FILE_LEN];
+    /*!
+     * Size in bytes at which the log file is rotated.
+     * Defaults to 0, the file is never rotated.
+     */
+    uint32_t log_file_max_size;
+    /*!
+     * Number of rotated log files kept.
+     * Defaults to 1.
+     */
+    uint8_t log_file_rotations;
 } __attribute__((__packed__));
 
 /**
@@ -70,6 +145,8 @@ logger_config_get();
 /**
  * @brief Logging function.
  *
+ * Called through the pr_*() macros, which check the level.
+ *
  * @param [in] level  Log level.
  * @param [in] msg Log message.
  * @param [in] format Logging message with the format.
@@ -78,6 +155,35 @@ logger_config_get();
 extern void
 logger(int level, char* msg, char const* format, ...);
 
+/**
+ * @brief Write an already formatted message.
+ *
+ * @param [in] level  Log level.
+ * @param [in] msg Log level name.
+ * @param [in] ts CLOCK_MONOTONIC time the message was generated at.
+ * @param [in] text Message text.
+ */
+extern void
+logger_write(int level, char* msg, struct timespec* ts, const char* text);
+
+/**
+ * @brief Start the log sink thread.
+ *
+ * Until the sink is started, messages are written by the calling thread.
+ * Afterwards they are queued and written in batches by the sink thread, a
+ * full queue drops the message instead of blocking the caller.
+ *
+ * @return 0 on success, -1 otherwise.
+ */
+extern int
+logger_start();
+
+/**
+ * @brief Write all queued messages and stop the log sink thread.
+ */
+extern void
+logger_stop();
+
 /**
  * @brief Enable system logging for the device.
  *
@@ -4,6 +4,7 @@
  * @note SPDX-License-Identifier: GPL-2.0+
  */
 
+#include <math.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <error.h>
@@ -14,8 +15,11 @@
 #include <sys/ioctl.h>
 #include <fcntl.h>
 #include <poll.h>
+#include <signal.h>
 #include <unistd.h>
 
+#include "actuator.h"
+#include "arena.h"
 #include "msg.h"
 #include "logger.h"
 #include "config.h"
@@ -23,11 +27,36 @@
 #include "servo.h"
 #include "utils.h"
 #include "clockadj.h"
+#include "filter.h"
 #include "tsproc.h"
 #include "servo.h"
+#include "trace.h"
+#include "metrics.h"
+#include "runtime.h"
+#include "stability.h"
+#include "stage.h"
+#include "status.h"
+#include "telemetry.h"
+#include "todsync.h"
+
+/* Fixed part of the instance state: tsproc, filter and servo structures. */
+#define ARENA_FIXED_SIZE (16 * 1024)
+/* Upper bound of the state per delay filter or outlier window sample. */
+#define ARENA_SAMPLE_SIZE 16
+/* Upper bound of one servo, the linreg servo with its points. */
+#define ARENA_SERVO_SIZE (4 * 1024)
+/* Empty receive attempts between two idle and metrics checks while busy polling. */
+#define BUSY_POLL_CHECK 1024
 
 struct servo_config servo_config;
 struct device_config device_config;
+static volatile sig_atomic_t dump_requested;
+/* Timestamps of the last delay measurement, for the telemetry ring. */
+static int64_t last_t3, last_t4;
+/* Clock stepped on a servo jump, the reference of the TOD loop if it runs. */
+static clockid_t step_clk_id;
+/* Phase correction limit of the frequency device [ns], 0 without offload. */
+static int32_t max_phase_adj;
 
 static int
 phc_caps_get(clockid_t clkid, struct ptp_clock_caps* caps)
@@ -96,6 +125,115 @@ device_init(struct device_config* device_config)
     return 0;
 }
 
+/* Open the follower devices and hand them to the actuator. */
+static int
+followers_init(struct device_config* device_config)
+{
+    char list[MAX_CONFIG_LIST_LEN];
+    char* save = NULL;
+    clockid_t clock_id;
+    char* name;
+
+    strcpy(list, device_config->follower_devices);
+    for (name = strtok_r(list, ", ", &save); name; name = strtok_r(NULL, ", ", &save)) {
+        clock_id = phc_init(name);
+        if (clock_id == CLOCK_INVALID) {
+            pr_err("follower device: %s", name);
+            return -1;
+        }
+        if (actuator_follow(clock_id, name, device_config->freq_dither, device_config->freq_resolution)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void
+phase_offload(int64_t phase)
+{
+    if (!phase) {
+        return;
+    }
+    if (phase > max_phase_adj || phase < -max_phase_adj) {
+        phase = phase > 0 ? max_phase_adj : -max_phase_adj;
+        metrics_inc(phase_clamped);
+    }
+    metrics_inc(phase_offloads);
+    actuator_set_phase(device_config.freq_clk_id, phase);
+}
+
+/* Keep a separate TOD device on its reference with a loop of its own. */
+static int
+tod_sync_init(struct device_config* device_config)
+{
+    struct servo_config tod_servo_config = servo_config;
+    struct ptp_clock_caps caps;
+    clockid_t ref;
+
+    step_clk_id = device_config->tod_clk_id;
+    if (device_config->tod_sync == TOD_SYNC_NONE) {
+        return 0;
+    }
+    if (device_config->tod_clk_id == device_config->freq_clk_id) {
+        pr_warning("tod_sync: tod_device is the frequency device, nothing to align");
+        return 0;
+    }
+    ref = device_config->tod_sync == TOD_SYNC_SYSTEM ? CLOCK_REALTIME : device_config->freq_clk_id;
+    if (phc_caps_get(device_config->tod_clk_id, &caps) < 0) {
+        return -1;
+    }
+    tod_servo_config.max_frequency = caps.max_adj;
+    if (todsync_start(device_config->tod_clk_id,
+                      ref,
+                      &tod_servo_config,
+                      device_config->tod_sync_interval,
+                      device_config->tod_sync_readings)) {
+        return -1;
+    }
+    /* The master time goes to the reference, the loop carries it over. */
+    step_clk_id = ref;
+    return 0;
+}
+
+static int
+delay_filter_length(struct device_config* device_config)
+{
+    double length;
+
+    if (device_config->filter != EXP_AVERAGE || device_config->filter_time_constant <= 0.0) {
+        return device_config->filter_len;
+    }
+    /* Time constant is given in seconds, convert it to delay measurements. */
+    length = device_config->filter_time_constant / ldexp(1.0, servo_config.logMinDelayReqInterval) + 0.5;
+    if (length > FILTER_EXP_AVERAGE_MAX_LENGTH) {
+        pr_warning("delay_filter_time_constant: longer than %d delay measurements, clamped",
+                   FILTER_EXP_AVERAGE_MAX_LENGTH);
+        return FILTER_EXP_AVERAGE_MAX_LENGTH;
+    }
+    return length < 1.0 ? 1 : (int)length;
+}
+
+/* Size of the arena holding tsproc, delay filter, outlier windows and servos. */
+static size_t
+arena_size(struct device_config* device_config)
+{
+    size_t size = ARENA_FIXED_SIZE;
+    int len = device_config->outlier_filter_len;
+
+    /* The exponential average keeps no samples, its length is a time constant. */
+    if (device_config->filter != EXP_AVERAGE) {
+        size += ARENA_SAMPLE_SIZE * delay_filter_length(device_config);
+    }
+    if (device_config->outlier_filter != OUTLIER_NONE) {
+        size += ARENA_SAMPLE_SIZE * 2 * (len ? len : OUTLIER_DEFAULT_LENGTH);
+    }
+    /* The TOD loop has a servo of its own. */
+    if (device_config->tod_sync != TOD_SYNC_NONE) {
+        size += ARENA_SERVO_SIZE;
+    }
+    return size;
+}
+
 static void
 clock_update(struct tsproc* tsp, struct servo* servo, int64_t t1, int64_t t2)
 {
@@ -111,38 +249,85 @@ clock_update(struct tsproc* tsp, struct servo* servo, int64_t t1, int64_t t2)
 
     tsproc_down_ts(tsp, remote_ts, local_ts);
     if (tsproc_update_offset(tsp, &master_offset, &weight)) {
+        stage_mark(STAGE_TSPROC);
+        metrics_inc(dropped[METRICS_TLV_SYNC]);
         return;
     }
+    stage_mark(STAGE_TSPROC);
 
     offset = tmv_to_nanoseconds(master_offset);
-    pr_debug("master_offset :%ld", offset);
+    trace_debug("master_offset :%ld", offset);
+    if (device_config.actuation_compensation) {
+        metrics_gauges.actuation_delay = actuator_delay();
+        servo_actuation_delay(servo, metrics_gauges.actuation_delay);
+        actuator_sample_ts(t2);
+    }
     adj = servo_sample(servo, offset, tmv_to_nanoseconds(local_ts), weight, &state);
-    pr_debug("adj : %f", adj);
+    stage_mark(STAGE_SERVO);
+    trace_debug("adj : %f", adj);
 
     tsproc_set_clock_rate_ratio(tsp, servo_rate_ratio(servo));
 
-    pr_debug("servo_sample: %d", state);
+    metrics_gauges.master_offset = offset;
+    metrics_gauges.servo_state = state;
+    metrics_hist_record(METRICS_HIST_OFFSET, offset);
+
+    trace_debug("servo_sample: %d", state);
     switch (state) {
     case SERVO_UNLOCKED:
         break;
     case SERVO_JUMP:
-        clockadj_set_freq(device_config.freq_clk_id, -adj);
-        clockadj_step(device_config.tod_clk_id, -offset);
+        metrics_inc(steps);
+        metrics_gauges.freq_adj = -adj;
+        actuator_jump(device_config.freq_clk_id, -adj, step_clk_id, -offset);
         tsproc_reset(tsp, 0);
         break;
     case SERVO_LOCKED:
-        clockadj_set_freq(device_config.freq_clk_id, -adj);
+        metrics_gauges.freq_adj = -adj;
+        actuator_set_freq(device_config.freq_clk_id, -adj);
         if (device_config.freq_clk_id == CLOCK_REALTIME) {
             sysclk_set_sync();
         }
         break;
     case SERVO_LOCKED_STABLE:
-        clockadj_set_phase(device_config.freq_clk_id, -adj);
+        if (max_phase_adj) {
+            /* The device removes the phase with its own loop, the servo tracks the frequency. */
+            adj = servo_drop_phase(servo, adj);
+            tsproc_set_clock_rate_ratio(tsp, servo_rate_ratio(servo));
+            metrics_gauges.freq_adj = -adj;
+            actuator_set_freq(device_config.freq_clk_id, -adj);
+            phase_offload(-offset);
+            break;
+        }
+        metrics_gauges.freq_adj = -adj;
+        actuator_set_freq(device_config.freq_clk_id, -adj);
         if (device_config.freq_clk_id == CLOCK_REALTIME) {
             sysclk_set_sync();
         }
         break;
     }
+    if (state != SERVO_UNLOCKED) {
+        stage_mark(STAGE_ADJUST);
+    }
+    /* Stability of the locked clock only, a step would dominate MTIE. */
+    if (state == SERVO_LOCKED || state == SERVO_LOCKED_STABLE) {
+        stab_sample(offset, metrics_gauges.freq_adj);
+    }
+
+    if (telemetry_enabled()) {
+        struct telemetry_record rec = {
+            .t1 = t1,
+            .t2 = t2,
+            .t3 = last_t3,
+            .t4 = last_t4,
+            .offset = offset,
+            .delay = tmv_to_nanoseconds(tsp->filtered_delay),
+            .weight = weight,
+            .adj = -adj,
+            .state = state,
+        };
+        telemetry_publish(&rec);
+    }
 }
 #ifdef LINUX_PTP
 static void
@@ -153,15 +338,72 @@ path_delay(struct tsproc* tsp, int64_t t3, int64_t t4)
     tmv_t delay;
     local_ts.ns = t3;
     remote_ts.ns = t4;
+    last_t3 = t3;
+    last_t4 = t4;
 
     tsproc_up_ts(tsp, local_ts, remote_ts);
 
     if (tsproc_update_delay(tsp, &delay)) {
+        stage_mark(STAGE_TSPROC);
+        metrics_inc(dropped[METRICS_TLV_DELAY]);
         return;
     }
+    stage_mark(STAGE_TSPROC);
+    metrics_gauges.delay_filtered = tmv_to_nanoseconds(tsp->filtered_delay);
+    metrics_gauges.delay_raw = tmv_to_nanoseconds(tsp->raw_delay);
+    metrics_hist_record(METRICS_HIST_DELAY_FILTERED, metrics_gauges.delay_filtered);
+    metrics_hist_record(METRICS_HIST_DELAY_RAW, metrics_gauges.delay_raw);
 }
 #endif
 
+/**
+ * @brief Process one datagram received in data.
+ *
+ * @return CLOCK_MONOTONIC time at the end of processing [ns].
+ */
+static uint64_t
+sample_process(struct tsproc* tsp, struct servo* servo, uint8_t* data)
+{
+    int64_t slave_time, master_time;
+    struct timespec now;
+    uint16_t msg_type = 0;
+    uint64_t now_ns;
+
+    process_message(data, &msg_type, &master_time, &slave_time);
+    stage_mark(STAGE_PARSE);
+
+    switch (msg_type) {
+    case TLV_SLAVE_RX_SYNC_TIMING_DATA:
+        metrics_inc(rx[METRICS_TLV_SYNC]);
+        /* Update the time adjust and phase adjust and freq adjust. */
+        clock_update(tsp, servo, master_time, slave_time);
+        break;
+#ifdef LINUX_PTP
+    case SLAVE_DELAY_TIMING_DATA_NP:
+        metrics_inc(rx[METRICS_TLV_DELAY]);
+        /* Update path delay for ts_proc */
+        path_delay(tsp, slave_time, master_time);
+        break;
+#endif
+    default:
+        metrics_inc(rx[METRICS_TLV_OTHER]);
+        metrics_inc(dropped[METRICS_TLV_OTHER]);
+        break;
+    }
+    stage_end();
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    now_ns = now.tv_sec * 1000000000ULL + now.tv_nsec;
+    metrics_hist_rotate(now_ns);
+    status_publish(now_ns);
+    return now_ns;
+}
+
+static void
+dump_request(int sig)
+{
+    dump_requested = 1;
+}
+
 void
 servo_configure(struct servo_config* config)
 {
@@ -181,17 +423,22 @@ main(int argc, char** argv)
     int rv, opt;
     char* config_file = NULL;
     struct servo* servo = NULL;
-    struct pollfd pollfd;
+    struct pollfd pollfd[1 + METRICS_MAX_POLLFDS];
+    struct timespec now;
+    struct sigaction sa;
+    int nfds;
     struct ptp_clock_caps caps;
-    double fadj;
-    uint16_t msg_type;
+    double fadj, sync_interval;
     struct tsproc* tsp = NULL;
     uint8_t running = 1;
-    uint16_t count;
+    int count;
     uint8_t data[MAX_PKT_LEN];
     int num_events;
-    int64_t slave_time, master_time;
+    uint64_t last_rx_ns, idle_ns;
+    unsigned int empty = 0;
+    int spinning, i;
     struct address addr;
+    struct logger_config* log_config;
     int n = 0;
     sys_log_init();
 
@@ -224,6 +471,17 @@ main(int argc, char** argv)
         goto err;
     }
 
+    if (logger_start()) {
+        pr_err("Error in starting log sink");
+        goto err;
+    }
+    log_config = logger_config_get();
+    if (log_config->trace_ring_size && (trace_start(log_config->trace_ring_size) || trace_register())) {
+        pr_err("Error in starting trace ring");
+        goto err;
+    }
+    metrics_register();
+
     /* Create UDS socket */
     device_config.fd = uds_create(device_config.uds_address, &device_config.daddr);
     if (device_config.fd < 0) {
@@ -237,11 +495,24 @@ main(int argc, char** argv)
         goto err;
     }
 
-    tsp = tsproc_create(device_config.mode, device_config.filter, device_config.filter_len);
+    /* All state of the sample path is laid out in one preallocated arena. */
+    if (arena_open(arena_size(&device_config))) {
+        goto err;
+    }
+    tsp = tsproc_create(device_config.mode, device_config.filter, delay_filter_length(&device_config));
     if (tsp == NULL) {
         pr_err("Error in tsproc intialization");
         goto err;
     }
+    rv = tsproc_set_outlier_filter(tsp,
+                                   device_config.outlier_filter,
+                                   device_config.outlier_filter_len,
+                                   device_config.outlier_threshold,
+                                   device_config.outlier_min_mad);
+    if (rv < 0) {
+        pr_err("Error in outlier filter intialization");
+        goto err;
+    }
     /* PHC frequency adjustments */
     rv = phc_caps_get(device_config.freq_clk_id, &caps);
     if (rv < 0) {
@@ -258,6 +529,22 @@ main(int argc, char** argv)
     fadj = clockadj_get_freq(device_config.freq_clk_id);
     clockadj_set_freq(device_config.freq_clk_id, fadj);
     servo_config.intial_adj = -fadj;
+    if (device_config.phase_offload) {
+        max_phase_adj = clockadj_max_phase(device_config.freq_clk_id);
+        if (max_phase_adj) {
+            pr_info("phase_offload: device corrects up to %d ns of phase", max_phase_adj);
+        } else {
+            pr_warning("phase_offload: no hardware phase adjustment, the servo keeps steering the frequency");
+        }
+    }
+    /* Drivers report the word they were given, the hardware step is not visible. */
+    if (device_config.freq_dither && device_config.freq_resolution <= 0.0) {
+        pr_err("freq_dither: set freq_resolution to the frequency step of the devices");
+        goto err;
+    }
+    if (device_config.freq_dither && actuator_dither(device_config.freq_clk_id, device_config.freq_resolution)) {
+        goto err;
+    }
 
     /* Servo parameter config */
     servo = servo_create(&servo_config);
@@ -266,44 +553,132 @@ main(int argc, char** argv)
         goto err;
     }
 
-    servo_sync_interval(servo, n < 0 ? 1.0 / (1 << -n) : 1 << n);
+    arena_report();
+
+    n = servo_config.logSyncInterval;
+    sync_interval = ldexp(1.0, n);
+    servo_sync_interval(servo, sync_interval);
+    stab_init(sync_interval);
+    stage_init();
+
+    /* SIGUSR1 logs the per stage latency, poll() is interrupted. */
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = dump_request;
+    sigaction(SIGUSR1, &sa, NULL);
+
+    rv = metrics_open(sync_interval, tsp);
+    if (rv < 0) {
+        pr_err("Error in opening metrics endpoint");
+        goto err;
+    }
+
+    /* Last, so the log sink and trace drain threads keep the default profile. */
+    rv = runtime_apply();
+    if (rv < 0) {
+        pr_err("Error in applying the runtime profile");
+        goto err;
+    }
+    /* The actuation and follower threads inherit the runtime profile. */
+    if (followers_init(&device_config)) {
+        pr_err("Error in starting the follower devices");
+        goto err;
+    }
+    if (device_config.actuation_mode == ACTUATION_PIPELINED && actuator_start()) {
+        pr_err("Error in starting the actuation thread");
+        goto err;
+    }
+    if (tod_sync_init(&device_config)) {
+        pr_err("Error in starting the TOD loop");
+        goto err;
+    }
+    /* The stepped clock carries the time scale of the sample time stamps. */
+    if (device_config.actuation_compensation) {
+        actuator_measure_delay(step_clk_id);
+    }
+
+    /* Busy polling falls back to poll() after two sync intervals without data by default. */
+    spinning = device_config.receive_mode == RECEIVE_BUSY_POLL;
+    idle_ns = device_config.busy_poll_idle ? device_config.busy_poll_idle * 1000ULL : 2e9 * sync_interval;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    last_rx_ns = now.tv_sec * 1000000000ULL + now.tv_nsec;
+
     /* Receive the packets using poll fd and then read the data and then pass the data to servo.
      */
-    pollfd.fd = device_config.fd;
-    pollfd.events = POLLIN | POLLPRI;
+    pollfd[0].fd = device_config.fd;
+    pollfd[0].events = POLLIN | POLLPRI;
 
     while (running) {
-        num_events = poll(&pollfd, 1, device_config.poll_time);
+        if (dump_requested) {
+            dump_requested = 0;
+            stage_dump();
+        }
+        nfds = 1 + metrics_pollfds(&pollfd[1]);
+
+        if (spinning) {
+            stage_begin();
+            count = uds_recv(device_config.fd, data, MAX_PKT_LEN, &addr, MSG_DONTWAIT);
+            if (count > 0) {
+                stage_mark(STAGE_RECV);
+                last_rx_ns = sample_process(tsp, servo, data);
+                continue;
+            }
+            if (count < 0 && errno != EAGAIN && errno != EINTR) {
+                pr_emerg("recv failed: %m");
+                return -1;
+            }
+            metrics_inc(spins);
+            for (i = 0; i < device_config.busy_poll_pause; i++) {
+                cpu_relax();
+            }
+            if (++empty % BUSY_POLL_CHECK) {
+                continue;
+            }
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            if (now.tv_sec * 1000000000ULL + now.tv_nsec - last_rx_ns > idle_ns) {
+                metrics_inc(spin_idle);
+                spinning = 0;
+            }
+            if (nfds > 1 && poll(&pollfd[1], nfds - 1, 0) > 0) {
+                metrics_handle(&pollfd[1], nfds - 1);
+            }
+            continue;
+        }
+
+        num_events = poll(pollfd, nfds, device_config.poll_time);
+        stage_begin();
 
         if (num_events < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
             pr_emerg("poll_failed");
             return -1;
         } else if (!num_events) {
             continue;
         }
-        if (pollfd.revents & (POLLIN | POLLPRI)) {
+        if (pollfd[0].revents & (POLLIN | POLLPRI)) {
             count = uds_recv(device_config.fd, data, MAX_PKT_LEN, &addr, 0);
-            if (count) {
-                rv = process_message(data, &msg_type, &master_time, &slave_time);
-
-                switch (msg_type) {
-                case TLV_SLAVE_RX_SYNC_TIMING_DATA:
-                    /* Update the time adjust and phase adjust and freq adjust. */
-                    clock_update(tsp, servo, master_time, slave_time);
-                    break;
-#ifdef LINUX_PTP
-                case SLAVE_DELAY_TIMING_DATA_NP:
-                    /* Update path delay for ts_proc */
-                    path_delay(tsp, slave_time, master_time);
-                    break;
-#endif
-                }
+            stage_mark(STAGE_RECV);
+            if (count > 0) {
+                last_rx_ns = sample_process(tsp, servo, data);
+                spinning = device_config.receive_mode == RECEIVE_BUSY_POLL;
             }
         }
+        /* Sample processing first, the metrics endpoint never blocks. */
+        metrics_handle(&pollfd[1], nfds - 1);
     }
 err:
+    todsync_stop();
+    actuator_stop();
     if (servo) {
         servo_destroy(servo);
     }
+    if (tsp) {
+        tsproc_destroy(tsp);
+    }
+    arena_close();
+    metrics_close();
+    trace_stop();
+    logger_stop();
     return -1;
 }
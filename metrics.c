@@ -0,0 +1,707 @@
+/**
+ * @file metrics.c
+ * @note Copyright (C) 2022 SyncMonk Technologies <services@syncmonk.net>
+ * @note SPDX-License-Identifier: GPL-2.0+
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "actuator.h"
+#include "logger.h"
+#include "metrics.h"
+#include "outlier.h"
+#include "stability.h"
+#include "status.h"
+#include "telemetry.h"
+#include "todsync.h"
+#include "tsproc.h"
+/******************************************************************************
+ * Local Definitions
+ *****************************************************************************/
+#define METRICS_MAX_CLIENTS (METRICS_MAX_POLLFDS - 2)
+#define METRICS_REQUEST_LEN 1024
+
+/*
+ * Upper bound of the exposition, counted with all followers, the TOD loop,
+ * both histogram windows and all stability levels: HELP and TYPE lines of
+ * every family plus every series, each shorter than METRICS_LINE_LEN with
+ * the longest instance and device names. A scrape that does not fit fails.
+ */
+#define METRICS_FAMILIES 37
+#define METRICS_FIXED_SERIES 33
+#define METRICS_LINE_LEN 256
+#define METRICS_SERIES                                                                                                 \
+    (METRICS_FIXED_SERIES + 5 * ACTUATOR_MAX_FOLLOWERS + 4 + METRICS_SERVO_STATES + METRICS_LATENCY_BUCKETS + 2 +      \
+     METRICS_HIST_MAX * 2 * (METRICS_QUANTILES + 2) + 3 * STAB_LEVELS)
+#define METRICS_BODY_LEN ((2 * METRICS_FAMILIES + METRICS_SERIES) * METRICS_LINE_LEN)
+
+#define METRICS_SERVO_STATES (int)(sizeof(servo_states) / sizeof(servo_states[0]))
+#define METRICS_QUANTILES (int)(sizeof(hist_quantiles) / sizeof(hist_quantiles[0]))
+
+struct metrics_hist_info
+{
+    const char* name;
+    const char* help;
+    /*! Extra labels, each followed by a comma. */
+    const char* labels;
+};
+
+struct metrics_client
+{
+    int fd;
+    int len;
+    char request[METRICS_REQUEST_LEN];
+};
+
+/* Counters of threads without their own, always the last of the list. */
+static struct metrics_counters lost_counters;
+
+__thread struct metrics_counters* metrics_local = &lost_counters;
+struct metrics_gauges metrics_gauges;
+struct hdrhist_window metrics_hist[METRICS_HIST_MAX];
+
+static struct metrics_config metrics_config;
+static struct tsproc* metrics_tsp;
+static struct metrics_counters* counters = &lost_counters;
+static pthread_mutex_t counters_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const uint64_t latency_bounds[] = { METRICS_LATENCY_BOUNDS };
+static const char* tlv_names[METRICS_TLV_MAX] = { "sync", "delay", "other" };
+static const char* outlier_kinds[2] = { "delay", "offset" };
+static const char* servo_states[] = { "unlocked", "jump", "locked", "locked_stable" };
+static const double hist_quantiles[] = { 0.5, 0.9, 0.99, 0.999, 0.9999, 1.0 };
+static const struct metrics_hist_info hist_info[METRICS_HIST_MAX] = {
+    [METRICS_HIST_OFFSET] = { "ext_servo_offset_abs_ns", "Magnitude of the offset from the master.", "" },
+    [METRICS_HIST_DELAY_FILTERED] = { "ext_servo_path_delay_dist_ns", "Mean path delay.", "kind=\"filtered\"," },
+    [METRICS_HIST_DELAY_RAW] = { "ext_servo_path_delay_dist_ns", "Mean path delay.", "kind=\"raw\"," },
+    [METRICS_HIST_PROCESSING] = { "ext_servo_stage_latency_ns", "Processing time per stage.", "stage=\"total\"," },
+    [METRICS_HIST_RECV] = { "ext_servo_stage_latency_ns", "Processing time per stage.", "stage=\"recv\"," },
+    [METRICS_HIST_PARSE] = { "ext_servo_stage_latency_ns", "Processing time per stage.", "stage=\"parse\"," },
+    [METRICS_HIST_TSPROC] = { "ext_servo_stage_latency_ns", "Processing time per stage.", "stage=\"tsproc\"," },
+    [METRICS_HIST_SERVO] = { "ext_servo_stage_latency_ns", "Processing time per stage.", "stage=\"servo\"," },
+    [METRICS_HIST_ADJUST] = { "ext_servo_stage_latency_ns", "Processing time per stage.", "stage=\"adjust\"," },
+};
+
+static int uds_fd = -1;
+static int tcp_fd = -1;
+static struct metrics_client clients[METRICS_MAX_CLIENTS] = { [0 ... METRICS_MAX_CLIENTS - 1] = { .fd = -1 } };
+
+/******************************************************************************
+ * Local Functions
+ *****************************************************************************/
+static int
+listen_socket(int fd, struct sockaddr* sa, socklen_t len)
+{
+    if (fd < 0) {
+        return -1;
+    }
+    if (bind(fd, sa, len) || listen(fd, METRICS_MAX_CLIENTS) || fcntl(fd, F_SETFL, O_NONBLOCK)) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int
+open_uds(const char* path)
+{
+    struct sockaddr_un sun;
+
+    memset(&sun, 0, sizeof(sun));
+    sun.sun_family = AF_LOCAL;
+    strncpy(sun.sun_path, path, sizeof(sun.sun_path) - 1);
+    unlink(path);
+    return listen_socket(socket(AF_LOCAL, SOCK_STREAM, 0), (struct sockaddr*)&sun, sizeof(sun));
+}
+
+static int
+open_tcp(const char* address, uint16_t port)
+{
+    struct sockaddr_in sin;
+    int fd, on = 1;
+
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_port = htons(port);
+    if (!inet_pton(AF_INET, strlen(address) ? address : "127.0.0.1", &sin.sin_addr)) {
+        return -1;
+    }
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd >= 0) {
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    }
+    return listen_socket(fd, (struct sockaddr*)&sin, sizeof(sin));
+}
+
+static void
+client_accept(int listen_fd)
+{
+    int i, fd;
+
+    fd = accept(listen_fd, NULL, NULL);
+    if (fd < 0) {
+        return;
+    }
+    for (i = 0; i < METRICS_MAX_CLIENTS; i++) {
+        if (clients[i].fd < 0) {
+            fcntl(fd, F_SETFL, O_NONBLOCK);
+            clients[i].fd = fd;
+            clients[i].len = 0;
+            return;
+        }
+    }
+    close(fd);
+}
+
+static void
+client_close(struct metrics_client* c)
+{
+    close(c->fd);
+    c->fd = -1;
+}
+
+/* Read the request, respond once the header is complete. */
+static void
+client_serve(struct metrics_client* c)
+{
+    static char body[METRICS_BODY_LEN];
+    char header[128];
+    int n, hlen, blen;
+
+    n = recv(c->fd, c->request + c->len, sizeof(c->request) - 1 - c->len, 0);
+    if (n <= 0) {
+        if (n == 0 || (errno != EAGAIN && errno != EINTR)) {
+            client_close(c);
+        }
+        return;
+    }
+    c->len += n;
+    c->request[c->len] = '\0';
+    if (!strstr(c->request, "\r\n\r\n") && !strstr(c->request, "\n\n") && c->len < (int)sizeof(c->request) - 1) {
+        return;
+    }
+
+    blen = metrics_format(body, sizeof(body));
+    if (blen >= (int)sizeof(body)) {
+        pr_err("metrics: %d bytes do not fit the %zu byte response buffer", blen, sizeof(body));
+        hlen = snprintf(header,
+                        sizeof(header),
+                        "HTTP/1.1 500 Internal Server Error\r\n"
+                        "Content-Length: 0\r\n"
+                        "Connection: close\r\n\r\n");
+        send(c->fd, header, hlen, MSG_DONTWAIT | MSG_NOSIGNAL);
+        client_close(c);
+        return;
+    }
+    hlen = snprintf(header,
+                    sizeof(header),
+                    "HTTP/1.1 200 OK\r\n"
+                    "Content-Type: text/plain; version=0.0.4\r\n"
+                    "Content-Length: %d\r\n"
+                    "Connection: close\r\n\r\n",
+                    blen);
+    /* The response fits the socket buffer, a short write only truncates it. */
+    send(c->fd, header, hlen, MSG_DONTWAIT | MSG_NOSIGNAL | MSG_MORE);
+    send(c->fd, body, blen, MSG_DONTWAIT | MSG_NOSIGNAL);
+    client_close(c);
+}
+
+/******************************************************************************
+ * Public Functions
+ *****************************************************************************/
+void
+metrics_register()
+{
+    struct metrics_counters* c;
+
+    if (metrics_local != &lost_counters) {
+        return;
+    }
+    c = calloc(1, sizeof(*c));
+    if (!c) {
+        pr_err("metrics: cannot allocate the counters of a thread, they are shared");
+        return;
+    }
+    pthread_mutex_lock(&counters_lock);
+    c->next = counters;
+    counters = c;
+    pthread_mutex_unlock(&counters_lock);
+
+    metrics_local = c;
+}
+
+void
+metrics_sum(struct metrics_counters* sum)
+{
+    struct metrics_counters* c;
+    uint64_t* dst = (uint64_t*)sum;
+    uint64_t* src;
+    unsigned int i, n = offsetof(struct metrics_counters, next) / sizeof(uint64_t);
+
+    memset(sum, 0, sizeof(*sum));
+    pthread_mutex_lock(&counters_lock);
+    for (c = counters; c; c = c->next) {
+        src = (uint64_t*)c;
+        for (i = 0; i < n; i++) {
+            dst[i] += __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+        }
+    }
+    pthread_mutex_unlock(&counters_lock);
+}
+
+void
+metrics_latency(uint64_t ns)
+{
+    struct metrics_counters* c = metrics_counters();
+    int i;
+
+    for (i = 0; i < METRICS_LATENCY_BUCKETS - 1 && ns > latency_bounds[i]; i++)
+        ;
+    c->latency[i]++;
+    c->latency_sum_ns += ns;
+}
+
+void
+metrics_configure(struct metrics_config* config)
+{
+    metrics_config = *config;
+}
+
+void
+metrics_hist_rotate(uint64_t now_ns)
+{
+    int i;
+
+    for (i = 0; i < METRICS_HIST_MAX; i++) {
+        hdrhist_window_rotate(&metrics_hist[i], now_ns);
+    }
+}
+
+int
+metrics_open(double sync_interval, struct tsproc* tsp)
+{
+    uint64_t interval = metrics_config.histogram_interval ? metrics_config.histogram_interval : METRICS_HIST_INTERVAL;
+    struct timespec ts;
+    int i;
+
+    metrics_tsp = tsp;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    for (i = 0; i < METRICS_HIST_MAX; i++) {
+        hdrhist_window_init(&metrics_hist[i], interval * 1000000000ULL, ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+    }
+
+    if (strlen(metrics_config.uds_address)) {
+        uds_fd = open_uds(metrics_config.uds_address);
+        if (uds_fd < 0) {
+            pr_err("metrics: cannot listen on %s: %m", metrics_config.uds_address);
+            return -1;
+        }
+    }
+    if (metrics_config.tcp_port) {
+        tcp_fd = open_tcp(metrics_config.tcp_address, metrics_config.tcp_port);
+        if (tcp_fd < 0) {
+            pr_err("metrics: cannot listen on TCP port %d: %m", metrics_config.tcp_port);
+            metrics_close();
+            return -1;
+        }
+    }
+    if (strlen(metrics_config.telemetry_file) &&
+        telemetry_open(metrics_config.telemetry_file, metrics_config.telemetry_records)) {
+        metrics_close();
+        return -1;
+    }
+    if (strlen(metrics_config.status_shm) && status_open(metrics_config.status_shm, sync_interval)) {
+        metrics_close();
+        return -1;
+    }
+    return 0;
+}
+
+void
+metrics_close()
+{
+    int i;
+
+    for (i = 0; i < METRICS_MAX_CLIENTS; i++) {
+        if (clients[i].fd >= 0) {
+            client_close(&clients[i]);
+        }
+    }
+    if (uds_fd >= 0) {
+        close(uds_fd);
+        unlink(metrics_config.uds_address);
+        uds_fd = -1;
+    }
+    if (tcp_fd >= 0) {
+        close(tcp_fd);
+        tcp_fd = -1;
+    }
+    telemetry_close();
+    status_close();
+    metrics_tsp = NULL;
+}
+
+void
+metrics_outliers(struct outlier_stats* delay, struct outlier_stats* offset)
+{
+    if (!metrics_tsp) {
+        memset(delay, 0, sizeof(*delay));
+        memset(offset, 0, sizeof(*offset));
+        return;
+    }
+    tsproc_outlier_stats(metrics_tsp, delay, offset);
+}
+
+int
+metrics_pollfds(struct pollfd* fds)
+{
+    int i, n = 0;
+
+    if (uds_fd >= 0) {
+        fds[n++] = (struct pollfd){ .fd = uds_fd, .events = POLLIN };
+    }
+    if (tcp_fd >= 0) {
+        fds[n++] = (struct pollfd){ .fd = tcp_fd, .events = POLLIN };
+    }
+    for (i = 0; i < METRICS_MAX_CLIENTS; i++) {
+        if (clients[i].fd >= 0) {
+            fds[n++] = (struct pollfd){ .fd = clients[i].fd, .events = POLLIN };
+        }
+    }
+    return n;
+}
+
+void
+metrics_handle(struct pollfd* fds, int n)
+{
+    int i, j;
+
+    for (i = 0; i < n; i++) {
+        if (!fds[i].revents) {
+            continue;
+        }
+        if (fds[i].fd == uds_fd || fds[i].fd == tcp_fd) {
+            client_accept(fds[i].fd);
+            continue;
+        }
+        for (j = 0; j < METRICS_MAX_CLIENTS; j++) {
+            if (clients[j].fd == fds[i].fd) {
+                client_serve(&clients[j]);
+            }
+        }
+    }
+}
+
+int
+metrics_format(char* buf, int len)
+{
+    const char* inst = strlen(metrics_config.instance) ? metrics_config.instance : logger_config_get()->msg_tag;
+    const struct metrics_hist_info* info;
+    const struct hdrhist* h;
+    struct metrics_counters sum;
+    struct stab_result stab[STAB_LEVELS];
+    struct actuator_follower_stats fs;
+    struct outlier_stats outliers[2];
+    struct todsync_status tod;
+    struct timespec ts;
+    uint64_t cumulative = 0;
+    int i, j, w, n = 0, state, levels;
+
+/* Past the end of the buffer only the length is counted. */
+#define OUT(...)                                                                                                       \
+    do {                                                                                                               \
+        n += snprintf(n < len ? buf + n : NULL, n < len ? len - n : 0, __VA_ARGS__);                                   \
+    } while (0)
+
+    metrics_sum(&sum);
+
+    OUT("# HELP ext_servo_master_offset_ns Last offset from the master.\n"
+        "# TYPE ext_servo_master_offset_ns gauge\n"
+        "ext_servo_master_offset_ns{instance=\"%s\"} %" PRId64 "\n",
+        inst,
+        metrics_gauges.master_offset);
+    OUT("# HELP ext_servo_path_delay_ns Last mean path delay.\n"
+        "# TYPE ext_servo_path_delay_ns gauge\n"
+        "ext_servo_path_delay_ns{instance=\"%s\",kind=\"filtered\"} %" PRId64 "\n"
+        "ext_servo_path_delay_ns{instance=\"%s\",kind=\"raw\"} %" PRId64 "\n",
+        inst,
+        metrics_gauges.delay_filtered,
+        inst,
+        metrics_gauges.delay_raw);
+    OUT("# HELP ext_servo_freq_adj_ppb Last frequency adjustment.\n"
+        "# TYPE ext_servo_freq_adj_ppb gauge\n"
+        "ext_servo_freq_adj_ppb{instance=\"%s\"} %.3f\n",
+        inst,
+        metrics_gauges.freq_adj);
+    OUT("# HELP ext_servo_actuation_delay_ns Average time from the sample to the frequency write, 0 if not measured.\n"
+        "# TYPE ext_servo_actuation_delay_ns gauge\n"
+        "ext_servo_actuation_delay_ns{instance=\"%s\"} %" PRId64 "\n",
+        inst,
+        metrics_gauges.actuation_delay);
+
+    state = metrics_gauges.servo_state;
+    OUT("# HELP ext_servo_state Servo state, 1 for the current state.\n"
+        "# TYPE ext_servo_state gauge\n");
+    for (i = 0; i < METRICS_SERVO_STATES; i++) {
+        OUT("ext_servo_state{instance=\"%s\",state=\"%s\"} %d\n", inst, servo_states[i], i == state);
+    }
+
+    OUT("# HELP ext_servo_steps_total Clock steps.\n"
+        "# TYPE ext_servo_steps_total counter\n"
+        "ext_servo_steps_total{instance=\"%s\"} %" PRIu64 "\n",
+        inst,
+        sum.steps);
+    OUT("# HELP ext_servo_samples_total Samples received per TLV type.\n"
+        "# TYPE ext_servo_samples_total counter\n");
+    for (i = 0; i < METRICS_TLV_MAX; i++) {
+        OUT("ext_servo_samples_total{instance=\"%s\",tlv=\"%s\"} %" PRIu64 "\n", inst, tlv_names[i], sum.rx[i]);
+    }
+    OUT("# HELP ext_servo_samples_dropped_total Samples which did not reach the servo per TLV type.\n"
+        "# TYPE ext_servo_samples_dropped_total counter\n");
+    for (i = 0; i < METRICS_TLV_MAX; i++) {
+        OUT("ext_servo_samples_dropped_total{instance=\"%s\",tlv=\"%s\"} %" PRIu64 "\n",
+            inst,
+            tlv_names[i],
+            sum.dropped[i]);
+    }
+    OUT("# HELP ext_servo_clock_adjtime_errors_total Failed clock_adjtime() calls.\n"
+        "# TYPE ext_servo_clock_adjtime_errors_total counter\n"
+        "ext_servo_clock_adjtime_errors_total{instance=\"%s\"} %" PRIu64 "\n",
+        inst,
+        sum.adjtime_errors);
+    OUT("# HELP ext_servo_busy_poll_spins_total Empty receive attempts while busy polling.\n"
+        "# TYPE ext_servo_busy_poll_spins_total counter\n"
+        "ext_servo_busy_poll_spins_total{instance=\"%s\"} %" PRIu64 "\n",
+        inst,
+        sum.spins);
+    OUT("# HELP ext_servo_busy_poll_idle_total Fallbacks from busy polling to poll() when idle.\n"
+        "# TYPE ext_servo_busy_poll_idle_total counter\n"
+        "ext_servo_busy_poll_idle_total{instance=\"%s\"} %" PRIu64 "\n",
+        inst,
+        sum.spin_idle);
+    OUT("# HELP ext_servo_actuations_total clock_adjtime() calls of the clock adjustments.\n"
+        "# TYPE ext_servo_actuations_total counter\n"
+        "ext_servo_actuations_total{instance=\"%s\"} %" PRIu64 "\n"
+        "# HELP ext_servo_actuations_coalesced_total Frequency adjustments superseded before they were applied.\n"
+        "# TYPE ext_servo_actuations_coalesced_total counter\n"
+        "ext_servo_actuations_coalesced_total{instance=\"%s\"} %" PRIu64 "\n"
+        "# HELP ext_servo_actuations_skipped_total Frequency adjustments which would not change the clock.\n"
+        "# TYPE ext_servo_actuations_skipped_total counter\n"
+        "ext_servo_actuations_skipped_total{instance=\"%s\"} %" PRIu64 "\n"
+        "# HELP ext_servo_actuations_merged_total Frequency adjustments merged into a clock step.\n"
+        "# TYPE ext_servo_actuations_merged_total counter\n"
+        "ext_servo_actuations_merged_total{instance=\"%s\"} %" PRIu64 "\n",
+        inst,
+        sum.actuations,
+        inst,
+        sum.actuations_coalesced,
+        inst,
+        sum.actuations_skipped,
+        inst,
+        sum.actuations_merged);
+    OUT("# HELP ext_servo_phase_offloads_total Phase corrections handed to the frequency device.\n"
+        "# TYPE ext_servo_phase_offloads_total counter\n"
+        "ext_servo_phase_offloads_total{instance=\"%s\"} %" PRIu64 "\n"
+        "# HELP ext_servo_phase_clamped_total Phase corrections clamped to the limit of the device.\n"
+        "# TYPE ext_servo_phase_clamped_total counter\n"
+        "ext_servo_phase_clamped_total{instance=\"%s\"} %" PRIu64 "\n",
+        inst,
+        sum.phase_offloads,
+        inst,
+        sum.phase_clamped);
+    OUT("# HELP ext_servo_actuation_seconds_total Time of the clock adjustments by phase.\n"
+        "# TYPE ext_servo_actuation_seconds_total counter\n"
+        "ext_servo_actuation_seconds_total{instance=\"%s\",phase=\"queue\"} %.9f\n"
+        "ext_servo_actuation_seconds_total{instance=\"%s\",phase=\"apply\"} %.9f\n",
+        inst,
+        sum.actuation_queue_ns / 1e9,
+        inst,
+        sum.actuation_apply_ns / 1e9);
+
+    metrics_outliers(&outliers[0], &outliers[1]);
+    OUT("# HELP ext_servo_outlier_samples_total Samples classified by the outlier detector.\n"
+        "# TYPE ext_servo_outlier_samples_total counter\n");
+    for (i = 0; i < 2; i++) {
+        OUT("ext_servo_outlier_samples_total{instance=\"%s\",kind=\"%s\"} %" PRIu64 "\n",
+            inst,
+            outlier_kinds[i],
+            outliers[i].samples);
+    }
+    OUT("# HELP ext_servo_outlier_rejected_total Samples rejected by the outlier detector.\n"
+        "# TYPE ext_servo_outlier_rejected_total counter\n");
+    for (i = 0; i < 2; i++) {
+        OUT("ext_servo_outlier_rejected_total{instance=\"%s\",kind=\"%s\"} %" PRIu64 "\n",
+            inst,
+            outlier_kinds[i],
+            outliers[i].rejected);
+    }
+    OUT("# HELP ext_servo_outlier_weighted_total Samples down-weighted by the outlier detector.\n"
+        "# TYPE ext_servo_outlier_weighted_total counter\n");
+    for (i = 0; i < 2; i++) {
+        OUT("ext_servo_outlier_weighted_total{instance=\"%s\",kind=\"%s\"} %" PRIu64 "\n",
+            inst,
+            outlier_kinds[i],
+            outliers[i].weighted);
+    }
+
+    /* Only with follower devices. */
+    if (!actuator_follower_stats(0, &fs)) {
+        OUT("# HELP ext_servo_follower_actuations_total Frequencies applied to a follower device.\n"
+            "# TYPE ext_servo_follower_actuations_total counter\n");
+        for (i = 0; !actuator_follower_stats(i, &fs); i++) {
+            OUT("ext_servo_follower_actuations_total{instance=\"%s\",device=\"%s\"} %" PRIu64 "\n",
+                inst,
+                fs.device,
+                fs.actuations);
+        }
+        OUT("# HELP ext_servo_follower_coalesced_total Frequencies superseded before a follower device applied them.\n"
+            "# TYPE ext_servo_follower_coalesced_total counter\n");
+        for (i = 0; !actuator_follower_stats(i, &fs); i++) {
+            OUT("ext_servo_follower_coalesced_total{instance=\"%s\",device=\"%s\"} %" PRIu64 "\n",
+                inst,
+                fs.device,
+                fs.coalesced);
+        }
+        OUT("# HELP ext_servo_follower_actuation_seconds_total Time of the follower adjustments by phase.\n"
+            "# TYPE ext_servo_follower_actuation_seconds_total counter\n");
+        for (i = 0; !actuator_follower_stats(i, &fs); i++) {
+            OUT("ext_servo_follower_actuation_seconds_total{instance=\"%s\",device=\"%s\",phase=\"queue\"} %.9f\n"
+                "ext_servo_follower_actuation_seconds_total{instance=\"%s\",device=\"%s\",phase=\"apply\"} %.9f\n",
+                inst,
+                fs.device,
+                fs.queue_ns / 1e9,
+                inst,
+                fs.device,
+                fs.apply_ns / 1e9);
+        }
+        OUT("# HELP ext_servo_follower_lag_seconds Time from posting to the end of the last follower adjustment.\n"
+            "# TYPE ext_servo_follower_lag_seconds gauge\n");
+        for (i = 0; !actuator_follower_stats(i, &fs); i++) {
+            OUT("ext_servo_follower_lag_seconds{instance=\"%s\",device=\"%s\"} %.9f\n", inst, fs.device, fs.lag_ns / 1e9);
+        }
+    }
+    /* Only with the TOD loop. */
+    if (!todsync_get(&tod)) {
+        OUT("# HELP ext_servo_tod_offset_ns Last offset of the TOD device from its reference.\n"
+            "# TYPE ext_servo_tod_offset_ns gauge\n"
+            "ext_servo_tod_offset_ns{instance=\"%s\"} %" PRId64 "\n"
+            "# HELP ext_servo_tod_cross_timestamp_ns Width of the last cross timestamp windows.\n"
+            "# TYPE ext_servo_tod_cross_timestamp_ns gauge\n"
+            "ext_servo_tod_cross_timestamp_ns{instance=\"%s\"} %" PRId64 "\n"
+            "# HELP ext_servo_tod_freq_adj_ppb Last frequency adjustment of the TOD device.\n"
+            "# TYPE ext_servo_tod_freq_adj_ppb gauge\n"
+            "ext_servo_tod_freq_adj_ppb{instance=\"%s\"} %.3f\n"
+            "# HELP ext_servo_tod_steps_total Steps of the TOD device.\n"
+            "# TYPE ext_servo_tod_steps_total counter\n"
+            "ext_servo_tod_steps_total{instance=\"%s\"} %" PRIu64 "\n",
+            inst,
+            tod.offset,
+            inst,
+            tod.delay,
+            inst,
+            tod.freq,
+            inst,
+            tod.steps);
+        OUT("# HELP ext_servo_tod_state State of the TOD servo, 1 for the current state.\n"
+            "# TYPE ext_servo_tod_state gauge\n");
+        for (i = 0; i < METRICS_SERVO_STATES; i++) {
+            OUT("ext_servo_tod_state{instance=\"%s\",state=\"%s\"} %d\n", inst, servo_states[i], i == tod.state);
+        }
+    }
+    OUT("# HELP ext_servo_processing_latency_seconds Time from poll() wakeup to the end of sample processing.\n"
+        "# TYPE ext_servo_processing_latency_seconds histogram\n");
+    for (i = 0; i < METRICS_LATENCY_BUCKETS - 1; i++) {
+        cumulative += sum.latency[i];
+        OUT("ext_servo_processing_latency_seconds_bucket{instance=\"%s\",le=\"%g\"} %" PRIu64 "\n",
+            inst,
+            latency_bounds[i] / 1e9,
+            cumulative);
+    }
+    cumulative += sum.latency[i];
+    OUT("ext_servo_processing_latency_seconds_bucket{instance=\"%s\",le=\"+Inf\"} %" PRIu64 "\n"
+        "ext_servo_processing_latency_seconds_sum{instance=\"%s\"} %.9f\n"
+        "ext_servo_processing_latency_seconds_count{instance=\"%s\"} %" PRIu64 "\n",
+        inst,
+        cumulative,
+        inst,
+        sum.latency_sum_ns / 1e9,
+        inst,
+        cumulative);
+
+    /* Summaries of the running and of the last complete interval. */
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    metrics_hist_rotate(ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+    for (i = 0; i < METRICS_HIST_MAX; i++) {
+        info = &hist_info[i];
+        if (!i || strcmp(info->name, hist_info[i - 1].name)) {
+            OUT("# HELP %s %s\n# TYPE %s summary\n", info->name, info->help, info->name);
+        }
+        for (w = 0; w < 2; w++) {
+            if (w && !metrics_hist[i].complete) {
+                break;
+            }
+            h = w ? &metrics_hist[i].last : &metrics_hist[i].cur;
+            for (j = 0; j < METRICS_QUANTILES; j++) {
+                OUT("%s{instance=\"%s\",%swindow=\"%s\",quantile=\"%g\"} %" PRIu64 "\n",
+                    info->name,
+                    inst,
+                    info->labels,
+                    w ? "last" : "current",
+                    hist_quantiles[j],
+                    hdrhist_quantile(h, hist_quantiles[j]));
+            }
+            OUT("%s_sum{instance=\"%s\",%swindow=\"%s\"} %" PRIu64 "\n"
+                "%s_count{instance=\"%s\",%swindow=\"%s\"} %" PRIu64 "\n",
+                info->name,
+                inst,
+                info->labels,
+                w ? "last" : "current",
+                h->sum,
+                info->name,
+                inst,
+                info->labels,
+                w ? "last" : "current",
+                h->count);
+        }
+    }
+
+    for (levels = 0; levels < STAB_LEVELS && !stab_get(levels, &stab[levels]); levels++)
+        ;
+    OUT("# HELP ext_servo_tdev_ns Time deviation of the offset while locked.\n"
+        "# TYPE ext_servo_tdev_ns gauge\n");
+    for (i = 0; i < levels; i++) {
+        if (stab[i].tdev >= 0) {
+            OUT("ext_servo_tdev_ns{instance=\"%s\",tau=\"%g\"} %.3f\n", inst, stab[i].tau, stab[i].tdev);
+        }
+    }
+    OUT("# HELP ext_servo_mtie_ns Maximum time interval error of the offset while locked.\n"
+        "# TYPE ext_servo_mtie_ns gauge\n");
+    for (i = 0; i < levels; i++) {
+        if (stab[i].mtie >= 0) {
+            OUT("ext_servo_mtie_ns{instance=\"%s\",tau=\"%g\"} %.1f\n", inst, stab[i].tau, stab[i].mtie);
+        }
+    }
+    OUT("# HELP ext_servo_adev Allan deviation of the frequency adjustment while locked.\n"
+        "# TYPE ext_servo_adev gauge\n");
+    for (i = 0; i < levels; i++) {
+        if (stab[i].adev >= 0) {
+            OUT("ext_servo_adev{instance=\"%s\",tau=\"%g\"} %.3e\n", inst, stab[i].tau, stab[i].adev);
+        }
+    }
+#undef OUT
+
+    return n;
+}
@@ -0,0 +1,245 @@
+/**
+ * @file metrics.h
+ * @brief Prometheus exporter for servo and clock state.
+ * @note Copyright (C) 2022 SyncMonk Technologies <services@syncmonk.net>
+ * @note SPDX-License-Identifier: GPL-2.0+
+ *
+ * Counters live in a per thread block and are incremented without atomic
+ * read-modify-write operations. They are summed over all threads only when
+ * the endpoint is scraped. Gauges are written by the sample path only.
+ * The endpoint is served from the main event loop with non-blocking
+ * sockets, one response per connection.
+ *
+ * Value distributions are kept in log-linear histograms rotated over the
+ * configured interval. They are written and exported by the main thread
+ * only.
+ */
+
+#ifndef __METRICS_H__
+#define __METRICS_H__
+
+#include <poll.h>
+#include <stdint.h>
+
+#include "config.h"
+#include "hdrhist.h"
+
+struct outlier_stats;
+struct tsproc;
+
+/*! Listening sockets plus connections being served. */
+#define METRICS_MAX_POLLFDS 6
+
+/*! Upper bounds of the processing latency histogram buckets in ns. */
+#define METRICS_LATENCY_BOUNDS                                                                                         \
+    1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000, 500000, 1000000, 2000000, 5000000, 10000000
+#define METRICS_LATENCY_BUCKETS 14
+
+/*! Default rotation interval of the histograms in seconds. */
+#define METRICS_HIST_INTERVAL 3600
+
+/**
+ * @brief TLV types counted by the exporter.
+ */
+enum metrics_tlv
+{
+    METRICS_TLV_SYNC,
+    METRICS_TLV_DELAY,
+    METRICS_TLV_OTHER,
+    METRICS_TLV_MAX,
+};
+
+/**
+ * @brief Value distributions, all in nanoseconds.
+ */
+enum metrics_hist
+{
+    /*! Magnitude of the master offset. */
+    METRICS_HIST_OFFSET,
+    METRICS_HIST_DELAY_FILTERED,
+    METRICS_HIST_DELAY_RAW,
+    /*! poll() wakeup to the end of the sample processing. */
+    METRICS_HIST_PROCESSING,
+    /*! Stages of the sample path, METRICS_HIST_PROCESSING + enum stage. */
+    METRICS_HIST_RECV,
+    METRICS_HIST_PARSE,
+    METRICS_HIST_TSPROC,
+    METRICS_HIST_SERVO,
+    METRICS_HIST_ADJUST,
+    METRICS_HIST_MAX,
+};
+
+/**
+ * @brief Per thread counters.
+ */
+struct metrics_counters
+{
+    /*! Samples received per TLV type. */
+    uint64_t rx[METRICS_TLV_MAX];
+    /*! Samples that did not reach the servo per TLV type. */
+    uint64_t dropped[METRICS_TLV_MAX];
+    /*! Clock steps. */
+    uint64_t steps;
+    /*! Failed clock_adjtime() calls. */
+    uint64_t adjtime_errors;
+    /*! Empty receive attempts while busy polling. */
+    uint64_t spins;
+    /*! Fallbacks from busy polling to poll() after the idle time. */
+    uint64_t spin_idle;
+    /*! clock_adjtime() calls of the clock adjustments. */
+    uint64_t actuations;
+    /*! Frequency adjustments superseded before they were applied. */
+    uint64_t actuations_coalesced;
+    /*! Frequency adjustments which would not change the clock. */
+    uint64_t actuations_skipped;
+    /*! Frequency adjustments merged into a step. */
+    uint64_t actuations_merged;
+    /*! Phase corrections handed to the device. */
+    uint64_t phase_offloads;
+    /*! Phase corrections clamped to the limit of the device. */
+    uint64_t phase_clamped;
+    /*! Time from posting to applying the adjustments [ns]. */
+    uint64_t actuation_queue_ns;
+    /*! Time spent in clock_adjtime() [ns]. */
+    uint64_t actuation_apply_ns;
+    /*! Processing latency, the last bucket counts values above all bounds. */
+    uint64_t latency[METRICS_LATENCY_BUCKETS];
+    uint64_t latency_sum_ns;
+    struct metrics_counters* next;
+};
+
+/**
+ * @brief Last values of the sample path.
+ */
+struct metrics_gauges
+{
+    int64_t master_offset;
+    int64_t delay_filtered;
+    int64_t delay_raw;
+    double freq_adj;
+    int servo_state;
+    int64_t actuation_delay;
+};
+
+/*! Counters of the calling thread, a shared block until it registers its own. */
+extern __thread struct metrics_counters* metrics_local;
+extern struct metrics_gauges metrics_gauges;
+extern struct hdrhist_window metrics_hist[METRICS_HIST_MAX];
+
+/**
+ * @brief Allocate and register the counters of the calling thread.
+ *
+ * Every thread calls it when it starts. Threads without counters of their
+ * own, or which failed to allocate them, add to a shared block which is
+ * summed like the others.
+ */
+void
+metrics_register();
+
+static inline struct metrics_counters*
+metrics_counters()
+{
+    return metrics_local;
+}
+
+/** Increment a counter of the calling thread. */
+#define metrics_inc(field) (metrics_counters()->field++)
+
+/**
+ * @brief Sum the counters of all registered threads.
+ *
+ * @param [out] sum Totals, its next pointer is NULL.
+ */
+void
+metrics_sum(struct metrics_counters* sum);
+
+/**
+ * @brief Account one processing latency.
+ *
+ * @param [in] ns Latency in nanoseconds.
+ */
+void
+metrics_latency(uint64_t ns);
+
+/**
+ * @brief Record a value into a histogram, negative values by magnitude.
+ *
+ * @param [in] id Histogram.
+ * @param [in] v Value in nanoseconds.
+ */
+static inline void
+metrics_hist_record(enum metrics_hist id, int64_t v)
+{
+    hdrhist_window_record(&metrics_hist[id], v < 0 ? -v : v);
+}
+
+/**
+ * @brief Rotate the histograms whose interval has elapsed.
+ *
+ * @param [in] now_ns CLOCK_MONOTONIC time in nanoseconds.
+ */
+void
+metrics_hist_rotate(uint64_t now_ns);
+
+/**
+ * @brief Open the configured listening sockets, telemetry ring and status
+ * page, start the histograms.
+ *
+ * @param [in] sync_interval Expected sync interval [s].
+ * @param [in] tsp Time stamp processor whose outlier counters are exported.
+ * @return 0 on success or when the exporter is disabled, -1 otherwise.
+ */
+int
+metrics_open(double sync_interval, struct tsproc* tsp);
+
+/**
+ * @brief Close all sockets of the exporter, the telemetry ring and the
+ * status page.
+ */
+void
+metrics_close();
+
+/**
+ * @brief Read the outlier detector counters of the sample path.
+ *
+ * Called from the main thread only, like the sample path itself.
+ *
+ * @param [out] delay Counters of the delay detector, zero when disabled.
+ * @param [out] offset Counters of the offset detector, zero when disabled.
+ */
+void
+metrics_outliers(struct outlier_stats* delay, struct outlier_stats* offset);
+
+/**
+ * @brief Fill poll descriptors for the exporter sockets.
+ *
+ * @param [out] fds Poll descriptors, at least METRICS_MAX_POLLFDS.
+ * @return Number of descriptors filled.
+ */
+int
+metrics_pollfds(struct pollfd* fds);
+
+/**
+ * @brief Serve the exporter sockets after poll().
+ *
+ * Never blocks: new connections are accepted, requests are read and the
+ * response is sent with a single non-blocking write.
+ *
+ * @param [in] fds Poll descriptors filled by @ref metrics_pollfds().
+ * @param [in] n Number of descriptors.
+ */
+void
+metrics_handle(struct pollfd* fds, int n);
+
+/**
+ * @brief Write the metrics in Prometheus text format.
+ *
+ * @param [out] buf Output buffer.
+ * @param [in] len Size of the output buffer.
+ * @return Length of the complete output, like snprintf(). The output was
+ *         truncated when it is not less than @a len.
+ */
+int
+metrics_format(char* buf, int len);
+
+#endif /* __METRICS_H__ */
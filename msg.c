@@ -4,12 +4,16 @@
  * @note SPDX-License-Identifier: GPL-2.0+
  */
 
+#define LOG_SUBSYS LOG_SUBSYS_MSG
+
 #include <stdint.h>
 #include <asm/byteorder.h>
 #include <arpa/inet.h>
 
 #include "msg.h"
 #include "logger.h"
+#include "probes.h"
+#include "trace.h"
 
 #define ntoh64(x) __be64_to_cpu(x)
 
@@ -33,7 +37,7 @@ process_rx_sync_msg(struct slave_rx_sync_timing_record* sync, int64_t* t1, int64
     *t2 = timestamp_ntohns(sync->syncEventIngressTimestamp);
     corr = ntoh64(sync->totalCorrectionField);
     *t1 = *t1 + (corr >> 16);
-    pr_debug("t1: %lld t2: %lld  corr: %lld", *t1, *t2, ntoh64(sync->totalCorrectionField));
+    trace_debug("t1: %lld t2: %lld  corr: %lld", *t1, *t2, ntoh64(sync->totalCorrectionField));
     return 0;
 }
 
@@ -47,7 +51,7 @@ process_delay_timing_msg(struct slave_delay_timing_record* delay, int64_t* t3, i
     *t4 = timestamp_ntohns(delay->delayResponseTimestamp);
     corr = ntoh64(delay->totalCorrectionField);
     *t4 = *t4 - (corr >> 16);
-    pr_debug("t3:%lld t4:%lld", *t3, *t4);
+    trace_debug("t3:%lld t4:%lld", *t3, *t4);
     return 0;
 }
 #endif
@@ -75,24 +79,28 @@ process_message(uint8_t* data, uint16_t* tlv_type, int64_t* master_time, int64_t
         *tlv_type = ntohs(tlv->type);
 
         if (*tlv_type == TLV_SLAVE_RX_SYNC_TIMING_DATA) {
-            pr_debug("TLV_SLAVE_RX_SYNC_TIMING_DATA tlv received.");
+            trace_debug("TLV_SLAVE_RX_SYNC_TIMING_DATA tlv received.");
             rx_sync_tlv = (struct slave_rx_sync_timing_data_tlv*)tlv;
             rx_sync_record = (struct slave_rx_sync_timing_record*)(rx_sync_tlv->record);
             process_rx_sync_msg(rx_sync_record, master_time, slave_time);
+            PROBE2(tlv_sync, *master_time, *slave_time);
         }
 #ifdef LINUX_PTP
         else if (*tlv_type == SLAVE_DELAY_TIMING_DATA_NP) {
-            pr_debug("SLAVE_DELAY_TIMING_DATA_NP tlv received");
+            trace_debug("SLAVE_DELAY_TIMING_DATA_NP tlv received");
             delay_tlv = (struct slave_delay_timing_data_tlv*)tlv;
             delay_record = (struct slave_delay_timing_record*)(delay_tlv->record);
             process_delay_timing_msg(delay_record, slave_time, master_time);
+            PROBE2(tlv_delay, *slave_time, *master_time);
         }
 #endif
         else {
-            pr_debug("Unexpected signalling TLV received: %d", tlv_type);
+            trace_debug("Unexpected signalling TLV received: %d", *tlv_type);
+            PROBE2(tlv_unknown, msg_type, *tlv_type);
         }
     } else {
-        pr_debug("Unexpected PTP message received: %d\n", msg_type);
+        trace_debug("Unexpected PTP message received: %d\n", msg_type);
+        PROBE2(tlv_unknown, msg_type, 0);
     }
     return 0;
 }
@@ -0,0 +1,234 @@
+/**
+ * @file outlier.c
+ * @note Copyright (C) 2022 SyncMonk Technologies <services@syncmonk.net>
+ * @note SPDX-License-Identifier: GPL-2.0+
+ */
+
+#define LOG_SUBSYS LOG_SUBSYS_TSPROC
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "arena.h"
+#include "outlier.h"
+#include "logger.h"
+
+/* Scale factor making the MAD a consistent estimator of sigma. */
+#define MAD_TO_SIGMA 1.4826
+
+struct outlier
+{
+    enum outlier_mode mode;
+    int cnt;
+    int len;
+    int index;
+    double threshold;
+    int64_t min_mad;
+    /* Values stored in circular buffer. */
+    int64_t* samples;
+    /* The same values in ascending order. */
+    int64_t* sorted;
+    struct outlier_stats stats;
+};
+
+/* Index of the first sorted value that is not less than val. */
+static int
+lower_bound(struct outlier* o, int64_t val)
+{
+    int lo = 0, hi = o->cnt, mid;
+
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (o->sorted[mid] < val)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static void
+sorted_remove(struct outlier* o, int64_t val)
+{
+    int i = lower_bound(o, val);
+
+    memmove(&o->sorted[i], &o->sorted[i + 1], (o->cnt - i - 1) * sizeof(*o->sorted));
+    o->cnt--;
+}
+
+static void
+sorted_insert(struct outlier* o, int64_t val)
+{
+    int i = lower_bound(o, val);
+
+    memmove(&o->sorted[i + 1], &o->sorted[i], (o->cnt - i) * sizeof(*o->sorted));
+    o->sorted[i] = val;
+    o->cnt++;
+}
+
+static int64_t
+median(struct outlier* o)
+{
+    if (o->cnt % 2)
+        return o->sorted[o->cnt / 2];
+    return (o->sorted[o->cnt / 2 - 1] + o->sorted[o->cnt / 2]) / 2;
+}
+
+/*
+ * Deviations from the median form two ascending sequences: the values below
+ * the median walked downwards (left) and the values from the median upwards
+ * (right). The k-th smallest deviation is then the k-th element of the union
+ * of two sorted arrays, which is found by bisection.
+ */
+static inline int64_t
+left_dev(struct outlier* o, int split, int64_t m, int i)
+{
+    return m - o->sorted[split - 1 - i];
+}
+
+static inline int64_t
+right_dev(struct outlier* o, int split, int64_t m, int j)
+{
+    return o->sorted[split + j] - m;
+}
+
+static int64_t
+kth_deviation(struct outlier* o, int split, int64_t m, int k)
+{
+    int nl = split, nr = o->cnt - split;
+    int lo = k + 1 > nr ? k + 1 - nr : 0;
+    int hi = k + 1 < nl ? k + 1 : nl;
+    int64_t l, r;
+    int i = lo, j;
+
+    while (lo <= hi) {
+        i = (lo + hi) / 2;
+        j = k + 1 - i;
+        if (i < nl && j > 0 && right_dev(o, split, m, j - 1) > left_dev(o, split, m, i))
+            lo = i + 1;
+        else if (i > 0 && j < nr && left_dev(o, split, m, i - 1) > right_dev(o, split, m, j))
+            hi = i - 1;
+        else
+            break;
+    }
+    j = k + 1 - i;
+
+    if (i == 0)
+        return right_dev(o, split, m, j - 1);
+    if (j == 0)
+        return left_dev(o, split, m, i - 1);
+    l = left_dev(o, split, m, i - 1);
+    r = right_dev(o, split, m, j - 1);
+    return l > r ? l : r;
+}
+
+static int64_t
+mad(struct outlier* o, int64_t m)
+{
+    int split = lower_bound(o, m);
+
+    if (o->cnt % 2)
+        return kth_deviation(o, split, m, o->cnt / 2);
+    return (kth_deviation(o, split, m, o->cnt / 2 - 1) + kth_deviation(o, split, m, o->cnt / 2)) / 2;
+}
+
+struct outlier*
+outlier_create(enum outlier_mode mode, int length, double threshold, int64_t min_mad)
+{
+    struct outlier* o;
+
+    switch (mode) {
+    case OUTLIER_MODE_NONE:
+    case OUTLIER_MODE_REJECT:
+    case OUTLIER_MODE_WEIGHT:
+        break;
+    default:
+        return NULL;
+    }
+    if (length < 0 || threshold < 0.0)
+        return NULL;
+
+    o = arena_calloc(1, sizeof(*o));
+    if (!o)
+        return NULL;
+
+    o->mode = mode;
+    o->len = length ? length : OUTLIER_DEFAULT_LENGTH;
+    o->threshold = threshold > 0.0 ? threshold : OUTLIER_DEFAULT_THRESHOLD;
+    o->min_mad = min_mad > 0 ? min_mad : 1;
+
+    o->samples = arena_calloc(o->len, sizeof(*o->samples));
+    if (!o->samples) {
+        arena_free(o);
+        return NULL;
+    }
+    o->sorted = arena_calloc(o->len, sizeof(*o->sorted));
+    if (!o->sorted) {
+        arena_free(o->samples);
+        arena_free(o);
+        return NULL;
+    }
+    return o;
+}
+
+void
+outlier_destroy(struct outlier* o)
+{
+    arena_free(o->sorted);
+    arena_free(o->samples);
+    arena_free(o);
+}
+
+double
+outlier_sample(struct outlier* o, tmv_t sample)
+{
+    int64_t val = tmv_to_nanoseconds(sample);
+    double weight = 1.0, limit, dev;
+    int64_t m;
+
+    if (o->mode == OUTLIER_MODE_NONE)
+        return 1.0;
+
+    o->stats.samples++;
+
+    /* Classify only against a full window. */
+    if (o->cnt == o->len) {
+        m = median(o);
+        limit = o->threshold * MAD_TO_SIGMA * (double)mad(o, m);
+        if (limit < o->threshold * o->min_mad)
+            limit = o->threshold * o->min_mad;
+
+        dev = llabs(val - m);
+        if (dev > limit) {
+            if (o->mode == OUTLIER_MODE_REJECT) {
+                weight = 0.0;
+                o->stats.rejected++;
+            } else {
+                weight = limit / dev;
+                o->stats.weighted++;
+            }
+            pr_debug("outlier %" PRId64 " median %" PRId64 " limit %.0f weight %f", val, m, limit, weight);
+        }
+        sorted_remove(o, o->samples[o->index]);
+    }
+
+    o->samples[o->index] = val;
+    o->index = (1 + o->index) % o->len;
+    sorted_insert(o, val);
+
+    return weight;
+}
+
+void
+outlier_reset(struct outlier* o)
+{
+    o->cnt = 0;
+    o->index = 0;
+}
+
+void
+outlier_get_stats(struct outlier* o, struct outlier_stats* stats)
+{
+    *stats = o->stats;
+}
@@ -0,0 +1,105 @@
+/**
+ * @file outlier.h
+ * @brief Streaming median/MAD based outlier detector.
+ * @note Copyright (C) 2022 SyncMonk Technologies <services@syncmonk.net>
+ * @note SPDX-License-Identifier: GPL-2.0+
+ */
+
+#ifndef __OUTLIER_H__
+#define __OUTLIER_H__
+
+#include <stdint.h>
+
+#include "tmv.h"
+
+/** Window length used when none is configured. */
+#define OUTLIER_DEFAULT_LENGTH 31
+/** Rejection threshold (in scaled MADs) used when none is configured. */
+#define OUTLIER_DEFAULT_THRESHOLD 5.0
+
+/** Opaque type */
+struct outlier;
+
+/**
+ * Defines what happens to a sample classified as an outlier.
+ */
+enum outlier_mode
+{
+    /* Detector disabled, every sample gets weight 1.0. */
+    OUTLIER_MODE_NONE,
+    /* Outliers get weight 0.0 and should be dropped by the caller. */
+    OUTLIER_MODE_REJECT,
+    /* Outliers get a weight proportional to threshold / deviation. */
+    OUTLIER_MODE_WEIGHT,
+};
+
+/**
+ * @brief Outlier detector counters.
+ */
+struct outlier_stats
+{
+    /*! Samples fed into the detector. */
+    uint64_t samples;
+    /*! Samples classified as outliers and rejected. */
+    uint64_t rejected;
+    /*! Samples classified as outliers and down-weighted. */
+    uint64_t weighted;
+};
+
+/**
+ * Create a new outlier detector.
+ *
+ * The detector keeps the last @a length samples both in arrival order and
+ * in sorted order. Median and median absolute deviation (MAD) are derived
+ * from the sorted window with O(log n) comparisons per sample, but keeping
+ * the window sorted moves O(n) values per sample. With at most 1024 samples
+ * that is a memmove of up to 8 kB, see outlier_sample in hotpath_bench.
+ *
+ * @param mode       What to do with outliers.
+ * @param length     Window length, 0 selects OUTLIER_DEFAULT_LENGTH.
+ * @param threshold  Rejection threshold k, a sample is an outlier when its
+ *                   distance from the median exceeds k * 1.4826 * MAD.
+ *                   0 selects OUTLIER_DEFAULT_THRESHOLD.
+ * @param min_mad    Lower bound for the MAD in nanoseconds, protects
+ *                   against a degenerate window of identical samples.
+ * @return A pointer to a new detector on success, NULL otherwise.
+ */
+struct outlier*
+outlier_create(enum outlier_mode mode, int length, double threshold, int64_t min_mad);
+
+/**
+ * Destroy an outlier detector.
+ * @param o  Pointer obtained via @ref outlier_create().
+ */
+void
+outlier_destroy(struct outlier* o);
+
+/**
+ * Classify a sample and add it to the window.
+ *
+ * The sample is always added to the window, so that a persistent change in
+ * the input is accepted once it occupies half of the window.
+ *
+ * @param o       Pointer obtained via @ref outlier_create().
+ * @param sample  The input sample.
+ * @return Weight of the sample in the range 0.0 - 1.0, 0.0 means rejected.
+ */
+double
+outlier_sample(struct outlier* o, tmv_t sample);
+
+/**
+ * Drop all samples from the window. Counters are preserved.
+ * @param o  Pointer obtained via @ref outlier_create().
+ */
+void
+outlier_reset(struct outlier* o);
+
+/**
+ * Read the detector counters.
+ * @param o      Pointer obtained via @ref outlier_create().
+ * @param stats  Where to store the counters.
+ */
+void
+outlier_get_stats(struct outlier* o, struct outlier_stats* stats);
+
+#endif /* __OUTLIER_H__ */
@@ -0,0 +1,53 @@
+/**
+ * @file probes.h
+ * @brief USDT (SystemTap / bpftrace) static probes.
+ * @note Copyright (C) 2022 SyncMonk Technologies <services@syncmonk.net>
+ * @note SPDX-License-Identifier: GPL-2.0+
+ *
+ * With HAVE_SDT defined (the Makefile does so when <sys/sdt.h> is found)
+ * every probe is a single nop in the text plus a note in .note.stapsdt,
+ * the arguments are only materialized in registers or on the stack. An
+ * attached tracer replaces the nop with a breakpoint. Without HAVE_SDT the
+ * probes compile out and their arguments are not evaluated.
+ *
+ * All probes belong to the provider ext_servo. Arguments are integers,
+ * fractional values are scaled as noted at the probe points:
+ *
+ *   tlv_sync(t1, t2)                        msg.c
+ *   tlv_delay(t3, t4)                       msg.c
+ *   tlv_unknown(msg_type, tlv_type)         msg.c
+ *   delay_update(raw, filtered, accepted)   tsproc.c
+ *   offset_update(offset, delay, weight_ppm, accepted)
+ *                                           tsproc.c
+ *   servo_sample(offset, adj_ppt, state)    servo.c
+ *   servo_state(old, new, offset)           servo.c
+ *   set_freq(clkid, freq_ppt, rc)           clockadj.c
+ *   keep_freq(clkid, freq_ppt)              actuator.c
+ *   set_phase(clkid, offset_ns, rc)         clockadj.c
+ *   step(clkid, step_ns, rc)                clockadj.c
+ *
+ * Times are in ns, ppt is parts per trillion (ppb * 1000), rc is the
+ * clock_adjtime() return value.
+ */
+
+#ifndef __PROBES_H__
+#define __PROBES_H__
+
+#ifdef HAVE_SDT
+
+#include <sys/sdt.h>
+
+#define PROBE2(name, a, b) DTRACE_PROBE2(ext_servo, name, a, b)
+#define PROBE3(name, a, b, c) DTRACE_PROBE3(ext_servo, name, a, b, c)
+#define PROBE4(name, a, b, c, d) DTRACE_PROBE4(ext_servo, name, a, b, c, d)
+
+#else
+
+/* sizeof keeps the arguments referenced without evaluating them. */
+#define PROBE2(name, a, b) ((void)sizeof(a), (void)sizeof(b))
+#define PROBE3(name, a, b, c) (PROBE2(name, a, b), (void)sizeof(c))
+#define PROBE4(name, a, b, c, d) (PROBE3(name, a, b, c), (void)sizeof(d))
+
+#endif /* HAVE_SDT */
+
+#endif /* __PROBES_H__ */
@@ -0,0 +1,296 @@
+/**
+ * @file runtime.c
+ * @note Copyright (C) 2022 SyncMonk Technologies <services@syncmonk.net>
+ * @note SPDX-License-Identifier: GPL-2.0+
+ */
+
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <malloc.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+#include "config.h"
+#include "logger.h"
+#include "runtime.h"
+/******************************************************************************
+ * Local Definitions
+ *****************************************************************************/
+static struct runtime_config runtime_config;
+/* Steps of the profile which did not take effect. */
+static int failures;
+
+static const int sched_policies[] = {
+    [SCHED_POLICY_OTHER] = SCHED_OTHER,
+    [SCHED_POLICY_FIFO] = SCHED_FIFO,
+    [SCHED_POLICY_RR] = SCHED_RR,
+};
+
+/******************************************************************************
+ * Local Functions
+ *****************************************************************************/
+static void
+check(int ok, const char* what)
+{
+    if (ok) {
+        pr_notice("runtime: %s", what);
+    } else {
+        pr_warning("runtime: %s NOT applied", what);
+        failures++;
+    }
+}
+
+/**
+ * @brief Parse a CPU list such as "1,4-6".
+ *
+ * @return 0 on success, -1 otherwise.
+ */
+static int
+parse_cpu_list(const char* list, cpu_set_t* set)
+{
+    const char* p = list;
+    char* end;
+    long a, b;
+
+    CPU_ZERO(set);
+    while (*p) {
+        a = strtol(p, &end, 10);
+        if (end == p || a < 0 || a >= CPU_SETSIZE) {
+            return -1;
+        }
+        b = a;
+        if (*end == '-') {
+            p = end + 1;
+            b = strtol(p, &end, 10);
+            if (end == p || b < a || b >= CPU_SETSIZE) {
+                return -1;
+            }
+        }
+        for (; a <= b; a++) {
+            CPU_SET(a, set);
+        }
+        if (*end == ',') {
+            end++;
+        } else if (*end) {
+            return -1;
+        }
+        p = end;
+    }
+    return CPU_COUNT(set) ? 0 : -1;
+}
+
+static void
+apply_affinity(cpu_set_t* set)
+{
+    char what[64];
+    cpu_set_t got;
+
+    if (sched_setaffinity(0, sizeof(*set), set)) {
+        pr_err("runtime: sched_setaffinity: %m");
+    }
+    snprintf(what, sizeof(what), "CPU affinity %s", runtime_config.cpu_affinity);
+    check(!sched_getaffinity(0, sizeof(got), &got) && CPU_EQUAL(&got, set), what);
+}
+
+static void
+apply_sched(int policy, int prio)
+{
+    struct sched_param sp = { .sched_priority = prio };
+    char what[64];
+
+    if (sched_setscheduler(0, policy, &sp)) {
+        pr_err("runtime: sched_setscheduler: %m");
+    }
+    snprintf(what, sizeof(what), "%s priority %d", policy == SCHED_FIFO ? "SCHED_FIFO" : "SCHED_RR", prio);
+    check(sched_getscheduler(0) == policy && !sched_getparam(0, &sp) && sp.sched_priority == prio, what);
+}
+
+/* Touch the stack below the caller, the pages stay locked and mapped. */
+static void __attribute__((noinline))
+prefault_stack(size_t size)
+{
+    volatile char* stack = alloca(size);
+    size_t i;
+
+    for (i = 0; i < size; i += 4096) {
+        stack[i] = 0;
+    }
+}
+
+static void
+prefault_heap(size_t size)
+{
+    char* heap;
+    size_t i;
+
+    /* Keep freed memory in the heap instead of returning it to the kernel. */
+    mallopt(M_TRIM_THRESHOLD, -1);
+    mallopt(M_MMAP_MAX, 0);
+    heap = malloc(size);
+    if (!heap) {
+        return;
+    }
+    for (i = 0; i < size; i += 4096) {
+        heap[i] = 0;
+    }
+    free(heap);
+}
+
+static void
+apply_mlock()
+{
+    uint32_t stack_kb = runtime_config.prefault_stack ? runtime_config.prefault_stack : RUNTIME_DEF_STACK_KB;
+    uint32_t heap_kb = runtime_config.prefault_heap ? runtime_config.prefault_heap : RUNTIME_DEF_HEAP_KB;
+    struct rusage before, after;
+    char what[64];
+    int rv;
+
+    rv = mlockall(MCL_CURRENT | MCL_FUTURE);
+    if (rv) {
+        pr_err("runtime: mlockall: %m");
+    }
+    check(!rv, "mlockall");
+
+    getrusage(RUSAGE_SELF, &before);
+    prefault_stack(stack_kb * 1024);
+    prefault_heap(heap_kb * 1024);
+    getrusage(RUSAGE_SELF, &after);
+    snprintf(what,
+             sizeof(what),
+             "prefaulted %u kB stack, %u kB heap (%ld faults)",
+             stack_kb,
+             heap_kb,
+             after.ru_minflt - before.ru_minflt);
+    check(1, what);
+}
+
+/**
+ * @brief Steer an IRQ to the CPU set and move its thread along.
+ *
+ * With threaded interrupts the handler of IRQ n runs in the kernel thread
+ * "irq/n-<name>". It gets the same CPUs and, with a real time policy, a
+ * priority above the sample path so it is never delayed by it.
+ */
+static void
+apply_irq(int irq, cpu_set_t* set, int prio)
+{
+    struct sched_param sp = { .sched_priority = prio < 99 ? prio + 1 : 99 };
+    char path[300], comm[64], prefix[32], what[128];
+    struct dirent* de;
+    int found = 0;
+    DIR* dir;
+    FILE* f;
+    int ok;
+
+    if (strlen(runtime_config.cpu_affinity)) {
+        snprintf(path, sizeof(path), "/proc/irq/%d/smp_affinity_list", irq);
+        f = fopen(path, "w");
+        ok = f && fprintf(f, "%s\n", runtime_config.cpu_affinity) > 0;
+        if (f && fclose(f)) {
+            ok = 0;
+        }
+        snprintf(what, sizeof(what), "IRQ %d on CPUs %s", irq, runtime_config.cpu_affinity);
+        check(ok, what);
+    }
+
+    dir = opendir("/proc");
+    if (!dir) {
+        return;
+    }
+    snprintf(prefix, sizeof(prefix), "irq/%d-", irq);
+    while ((de = readdir(dir))) {
+        if (de->d_name[0] < '1' || de->d_name[0] > '9') {
+            continue;
+        }
+        snprintf(path, sizeof(path), "/proc/%s/comm", de->d_name);
+        f = fopen(path, "r");
+        if (!f) {
+            continue;
+        }
+        if (!fgets(comm, sizeof(comm), f) || strncmp(comm, prefix, strlen(prefix))) {
+            fclose(f);
+            continue;
+        }
+        fclose(f);
+        found = 1;
+        ok = 1;
+        if (strlen(runtime_config.cpu_affinity) && sched_setaffinity(atoi(de->d_name), sizeof(*set), set)) {
+            ok = 0;
+        }
+        if (prio && sched_setscheduler(atoi(de->d_name), SCHED_FIFO, &sp)) {
+            ok = 0;
+        }
+        comm[strcspn(comm, "\n")] = '\0';
+        snprintf(what, sizeof(what), "thread %s pinned, priority %d", comm, prio ? sp.sched_priority : 0);
+        check(ok, what);
+    }
+    closedir(dir);
+    if (!found) {
+        pr_info("runtime: IRQ %d is not threaded", irq);
+    }
+}
+
+/* Real time throttling takes the CPU away from a busy real time task. */
+static void
+check_rt_throttling()
+{
+    long runtime_us = -1;
+    FILE* f;
+
+    f = fopen("/proc/sys/kernel/sched_rt_runtime_us", "r");
+    if (!f) {
+        return;
+    }
+    if (fscanf(f, "%ld", &runtime_us) == 1 && runtime_us >= 0) {
+        pr_info("runtime: real time throttling at %ld us per period", runtime_us);
+    }
+    fclose(f);
+}
+
+/******************************************************************************
+ * Public Functions
+ *****************************************************************************/
+void
+runtime_configure(struct runtime_config* config)
+{
+    runtime_config = *config;
+}
+
+int
+runtime_apply()
+{
+    int policy = sched_policies[runtime_config.sched_policy];
+    int prio = 0;
+    cpu_set_t set;
+
+    failures = 0;
+    CPU_ZERO(&set);
+    if (strlen(runtime_config.cpu_affinity)) {
+        if (parse_cpu_list(runtime_config.cpu_affinity, &set)) {
+            pr_err("runtime: invalid cpu_affinity %s", runtime_config.cpu_affinity);
+            return -1;
+        }
+        apply_affinity(&set);
+    }
+    if (policy != SCHED_OTHER) {
+        prio = runtime_config.sched_priority ? runtime_config.sched_priority : RUNTIME_DEF_PRIORITY;
+        apply_sched(policy, prio);
+        check_rt_throttling();
+    }
+    if (runtime_config.mlock) {
+        apply_mlock();
+    }
+    if (runtime_config.irq) {
+        apply_irq(runtime_config.irq, &set, prio);
+    }
+
+    if (failures) {
+        pr_warning("runtime: %d part(s) of the execution profile not applied", failures);
+        return runtime_config.strict ? -1 : 0;
+    }
+    return 0;
+}
@@ -0,0 +1,31 @@
+/**
+ * @file runtime.h
+ * @brief Real time execution profile of the sample path.
+ * @note Copyright (C) 2022 SyncMonk Technologies <services@syncmonk.net>
+ * @note SPDX-License-Identifier: GPL-2.0+
+ *
+ * Applied by the main thread once the helper threads (log sink, trace
+ * drain) run, so only the sample path gets the real time class and the
+ * CPU mask; threads created later inherit both. Every step is read back
+ * from the kernel and logged, a step that did not take effect is a
+ * warning, or fatal with strict set.
+ */
+
+#ifndef __RUNTIME_H__
+#define __RUNTIME_H__
+
+/*! Default real time priority, the one of threaded IRQs. */
+#define RUNTIME_DEF_PRIORITY 50
+/*! Default prefaulted stack and heap with mlock [kB]. */
+#define RUNTIME_DEF_STACK_KB 256
+#define RUNTIME_DEF_HEAP_KB 4096
+
+/**
+ * @brief Apply the configured profile to the calling thread.
+ *
+ * @return 0 on success or if not strict, -1 otherwise.
+ */
+int
+runtime_apply();
+
+#endif /* __RUNTIME_H__ */
@@ -0,0 +1,59 @@
+/**
+ * @file seqlock.h
+ * @brief Sequence counter for a single writer and lock free readers.
+ * @note Copyright (C) 2022 SyncMonk Technologies <services@syncmonk.net>
+ * @note SPDX-License-Identifier: GPL-2.0+
+ *
+ * The counter is odd while the writer updates the protected data. A reader
+ * takes the counter, copies the data and retries if the counter was odd or
+ * has changed meanwhile. Readers never block the writer, the writer never
+ * waits for readers. The protected data must only be copied by readers,
+ * never dereferenced through pointers it contains.
+ */
+
+#ifndef __SEQLOCK_H__
+#define __SEQLOCK_H__
+
+#include <stdint.h>
+
+static inline void
+seqlock_write_begin(uint64_t* seq)
+{
+    __atomic_store_n(seq, *seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void
+seqlock_write_end(uint64_t* seq)
+{
+    __atomic_store_n(seq, *seq + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Start a read section.
+ *
+ * @param [in] seq Sequence counter.
+ * @return Counter value to pass to seqlock_read_retry(), odd while a
+ * write is in progress.
+ */
+static inline uint64_t
+seqlock_read_begin(const uint64_t* seq)
+{
+    return __atomic_load_n(seq, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * @brief End a read section.
+ *
+ * @param [in] seq Sequence counter.
+ * @param [in] start Value returned by seqlock_read_begin().
+ * @return Non zero if the copied data may be torn and must be read again.
+ */
+static inline int
+seqlock_read_retry(const uint64_t* seq, uint64_t start)
+{
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return (start & 1) || __atomic_load_n(seq, __ATOMIC_RELAXED) != start;
+}
+
+#endif /* __SEQLOCK_H__ */
@@ -4,12 +4,16 @@
  * @note Copyright (C) 2014 Miroslav Lichvar <mlichvar@redhat.com>
  * @note SPDX-License-Identifier: GPL-2.0+
  */ 
+#define LOG_SUBSYS LOG_SUBSYS_SERVO
+
 #include <stdint.h>
 #include <stdlib.h>
 #include <math.h>
 
+#include "arena.h"
 #include "linreg.h"
 #include "logger.h"
+#include "trace.h"
 #include "servo.h"
 
 /* Maximum and minimum number of points used in regression,
@@ -66,6 +70,10 @@ struct linreg_servo
     unsigned int size;
     /* Current frequency offset of the clock */
     double clock_freq;
+    /* Frequency offset in effect until the current one was applied */
+    double prev_freq;
+    /* Frequency offset given by the slope, without the offset correction */
+    double slope_freq;
     /* Expected interval between updates */
     double update_interval;
     /* Current ratio between remote and local frequency */
@@ -78,7 +86,7 @@ static void
 linreg_destroy(struct servo* servo)
 {
     struct linreg_servo* s = container_of(servo, struct linreg_servo, servo);
-    free(s);
+    arena_free(s);
 }
 
 static void
@@ -101,13 +109,19 @@ static void
 update_reference(struct linreg_servo* s, uint64_t local_ts)
 {
     double x_interval;
-    int64_t y_interval;
+    int64_t y_interval, delay;
 
     if (s->last_update) {
         y_interval = local_ts - s->last_update;
 
-        /* Remove current frequency correction from the interval */
-        x_interval = y_interval / (1.0 + s->clock_freq / 1e9);
+        /*
+         * Remove the frequency corrections from the interval, the previous
+         * one was in effect until the current one was applied.
+         */
+        delay = s->servo.actuation_delay;
+        if (delay > y_interval)
+            delay = y_interval;
+        x_interval = delay / (1.0 + s->prev_freq / 1e9) + (y_interval - delay) / (1.0 + s->clock_freq / 1e9);
         x_interval += s->x_remainder;
         s->x_remainder = x_interval - (int64_t)x_interval;
 
@@ -214,14 +228,15 @@ linreg_sample(struct servo* servo, int64_t offset, uint64_t local_ts, double wei
 {
     struct linreg_servo* s = container_of(servo, struct linreg_servo, servo);
     struct result* res;
+    double intercept, freq;
     int corr_interval;
 
     /*
-     * The current time and the time when will be the frequency of the
-     * clock actually updated is assumed here to be equal to local_ts
-     * (which is the time stamp of the received sync message). As long as
-     * the differences are smaller than the update interval, the loop
-     * should be robust enough to handle this simplification.
+     * The frequency of the clock is actually updated actuation_delay
+     * after local_ts (which is the time stamp of the received sync
+     * message), zero unless measured. Until then the clock keeps running
+     * with the current frequency, which is accounted for in the reference
+     * and in the predicted offset.
      */
 
     update_reference(s, local_ts);
@@ -233,12 +248,13 @@ linreg_sample(struct servo* servo, int64_t offset, uint64_t local_ts, double wei
     if (s->size < MIN_SIZE) {
         /* Not enough points, wait for more */
         *state = SERVO_UNLOCKED;
+        s->prev_freq = s->clock_freq;
         return -s->clock_freq;
     }
 
     res = &s->results[s->size - MIN_SIZE];
 
-    pr_debug(
+    trace_debug(
       "linreg: points %d slope %.9f intercept %.0f err %.0f", 1 << s->size, res->slope, res->intercept, res->err);
 
     if ((servo->first_update && servo->first_step_threshold && servo->first_step_threshold < fabs(res->intercept)) ||
@@ -252,7 +268,12 @@ linreg_sample(struct servo* servo, int64_t offset, uint64_t local_ts, double wei
     }
 
     /* Set clock frequency to the slope */
+    freq = s->clock_freq;
     s->clock_freq = 1e9 * (res->slope - 1.0);
+    s->slope_freq = s->clock_freq;
+
+    /* Offset at the time the new frequency takes effect */
+    intercept = res->intercept + servo->actuation_delay * (s->clock_freq - freq) / 1e9;
 
     /*
      * Adjust the frequency to correct the time offset. Use longer
@@ -263,7 +284,7 @@ linreg_sample(struct servo* servo, int64_t offset, uint64_t local_ts, double wei
      * the system clock's maximum adjustment of 10% that's acceptable.
      */
     corr_interval = s->size <= 4 ? 1 : s->size / 2;
-    s->clock_freq += res->intercept / s->update_interval / corr_interval;
+    s->clock_freq += intercept / s->update_interval / corr_interval;
 
     /* Clamp the frequency to the allowed maximum */
     if (s->clock_freq > servo->max_frequency)
@@ -272,6 +293,24 @@ linreg_sample(struct servo* servo, int64_t offset, uint64_t local_ts, double wei
         s->clock_freq = -servo->max_frequency;
 
     s->frequency_ratio = res->slope / (1.0 + s->clock_freq / 1e9);
+    s->prev_freq = freq;
+
+    return -s->clock_freq;
+}
+
+static double
+linreg_drop_phase(struct servo* servo)
+{
+    struct linreg_servo* s = container_of(servo, struct linreg_servo, servo);
+    double slope = 1.0 + s->slope_freq / 1e9;
+
+    s->clock_freq = s->slope_freq;
+    if (s->clock_freq > servo->max_frequency)
+        s->clock_freq = servo->max_frequency;
+    else if (s->clock_freq < -servo->max_frequency)
+        s->clock_freq = -servo->max_frequency;
+
+    s->frequency_ratio = slope / (1.0 + s->clock_freq / 1e9);
 
     return -s->clock_freq;
 }
@@ -329,7 +368,7 @@ linreg_servo_create(struct servo_config* cfg)
 {
     struct linreg_servo* s;
 
-    s = calloc(1, sizeof(*s));
+    s = arena_calloc(1, sizeof(*s));
     if (!s)
         return NULL;
 
@@ -339,8 +378,10 @@ linreg_servo_create(struct servo_config* cfg)
     s->servo.reset = linreg_reset;
     s->servo.rate_ratio = linreg_rate_ratio;
     s->servo.leap = linreg_leap;
+    s->servo.drop_phase = linreg_drop_phase;
 
     s->clock_freq = -cfg->intial_adj;
+    s->prev_freq = s->clock_freq;
     s->frequency_ratio = 1.0;
 
     return &s->servo;
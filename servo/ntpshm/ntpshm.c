@@ -6,10 +6,13 @@
  * @note SPDX-License-Identifier: GPL-2.0+
  */
  
+#define LOG_SUBSYS LOG_SUBSYS_SERVO
+
 #include <stdlib.h>
 #include <sys/types.h>
 #include <sys/shm.h>
 
+#include "arena.h"
 #include "config.h"
 #include "logger.h"
 #include "ntpshm.h"
@@ -63,7 +66,7 @@ ntpshm_destroy(struct servo* servo)
     struct ntpshm_servo* s = container_of(servo, struct ntpshm_servo, servo);
 
     shmdt(s->shm);
-    free(s);
+    arena_free(s);
 }
 
 static double
@@ -130,7 +133,7 @@ ntpshm_servo_create(struct servo_config* cfg)
     int ntpshm_segment = cfg->ntpshm_segment;
     int shmid;
 
-    s = calloc(1, sizeof(*s));
+    s = arena_calloc(1, sizeof(*s));
     if (!s)
         return NULL;
 
@@ -143,14 +146,14 @@ ntpshm_servo_create(struct servo_config* cfg)
     shmid = shmget(SHMKEY + ntpshm_segment, sizeof(struct shmTime), IPC_CREAT | 0600);
     if (shmid == -1) {
         pr_err("ntpshm: shmget failed: %m");
-        free(s);
+        arena_free(s);
         return NULL;
     }
 
     s->shm = (struct shmTime*)shmat(shmid, 0, 0);
     if (s->shm == (void*)-1) {
         pr_err("ntpshm: shmat failed: %m");
-        free(s);
+        arena_free(s);
         return NULL;
     }
 
@@ -4,14 +4,18 @@
  * @note Copyright (C) 2011 Richard Cochran <richardcochran@gmail.com>
  * @note SPDX-License-Identifier: GPL-2.0+
  */ 
+#define LOG_SUBSYS LOG_SUBSYS_SERVO
+
 #include <stdint.h>
 #include <stdlib.h>
 #include <math.h>
 
+#include "arena.h"
 #include "utils.h"
 #include "config.h"
 #include "pi.h"
 #include "logger.h"
+#include "trace.h"
 #include "servo.h"
 
 #define HWTS_KP_SCALE 0.7
@@ -49,7 +53,7 @@ static void
 pi_destroy(struct servo* servo)
 {
     struct pi_servo* s = container_of(servo, struct pi_servo, servo);
-    free(s);
+    arena_free(s);
 }
 
 static double
@@ -57,7 +61,7 @@ pi_sample(struct servo* servo, int64_t offset, uint64_t local_ts, double weight,
 {
     struct pi_servo* s = container_of(servo, struct pi_servo, servo);
     double ki_term, ppb = s->last_freq;
-    double freq_est_interval, localdiff;
+    double freq_est_interval, localdiff, offset_eff;
 
     switch (s->count) {
     case 0:
@@ -84,7 +88,7 @@ pi_sample(struct servo* servo, int64_t offset, uint64_t local_ts, double weight,
         if (freq_est_interval > 1000.0) {
             freq_est_interval = 1000.0;
         }
-        pr_debug("localdiff %f < freq_est_interval %f", localdiff, freq_est_interval);
+        trace_debug("localdiff %f < freq_est_interval %f", localdiff, freq_est_interval);
         if (localdiff < freq_est_interval) {
             *state = SERVO_UNLOCKED;
             break;
@@ -98,18 +102,18 @@ pi_sample(struct servo* servo, int64_t offset, uint64_t local_ts, double weight,
         else if (s->drift > servo->max_frequency)
             s->drift = servo->max_frequency;
 
-        pr_debug(
-          "first_update:  %d first_step_thd: %f offset: %f", servo->first_update, servo->first_step_threshold, offset);
+        trace_debug(
+          "first_update:  %d first_step_thd: %f offset: %ld", servo->first_update, servo->first_step_threshold, offset);
         if ((servo->first_update && servo->first_step_threshold && servo->first_step_threshold < llabs(offset)) ||
             (servo->step_threshold && servo->step_threshold < llabs(offset))) {
-            pr_debug("%s %d", __func__, __LINE__);
+            trace_debug("%s %d", __func__, __LINE__);
             *state = SERVO_JUMP;
         } else {
-            pr_debug("%s %d", __func__, __LINE__);
+            trace_debug("%s %d", __func__, __LINE__);
             *state = SERVO_LOCKED;
         }
         ppb = s->drift;
-        pr_debug("ppb: %f", ppb);
+        trace_debug("ppb: %f", ppb);
         s->count = 2;
         break;
     case 2:
@@ -126,9 +130,22 @@ pi_sample(struct servo* servo, int64_t offset, uint64_t local_ts, double weight,
             break;
         }
 
-        ki_term = s->ki * offset * weight;
-        ppb = s->kp * offset * weight + s->drift + ki_term;
-        pr_debug("kp: %f offset: %ld weight: %f drift: %f ki_term: %f", s->kp, offset, weight, s->drift, ki_term);
+        /*
+         * The new frequency takes effect actuation_delay after local_ts,
+         * until then the clock drifts with the last one. Correct the
+         * offset expected at that time.
+         */
+        offset_eff = offset + (s->drift - s->last_freq) * servo->actuation_delay / 1e9;
+
+        ki_term = s->ki * offset_eff * weight;
+        ppb = s->kp * offset_eff * weight + s->drift + ki_term;
+        trace_debug("kp: %f offset: %ld offset_eff: %f weight: %f drift: %f ki_term: %f",
+                    s->kp,
+                    offset,
+                    offset_eff,
+                    weight,
+                    s->drift,
+                    ki_term);
         if (ppb < -servo->max_frequency) {
             ppb = -servo->max_frequency;
         } else if (ppb > servo->max_frequency) {
@@ -143,6 +160,16 @@ pi_sample(struct servo* servo, int64_t offset, uint64_t local_ts, double weight,
     return ppb;
 }
 
+static double
+pi_drop_phase(struct servo* servo)
+{
+    struct pi_servo* s = container_of(servo, struct pi_servo, servo);
+
+    /* The integral term went into the drift, which tracks the frequency. */
+    s->last_freq = s->drift;
+    return s->drift;
+}
+
 static void
 pi_sync_interval(struct servo* servo, double interval)
 {
@@ -172,7 +199,7 @@ pi_servo_create(struct servo_config* cfg)
 {
     struct pi_servo* s;
 
-    s = calloc(1, sizeof(*s));
+    s = arena_calloc(1, sizeof(*s));
     if (!s)
         return NULL;
 
@@ -180,6 +207,7 @@ pi_servo_create(struct servo_config* cfg)
     s->servo.sample = pi_sample;
     s->servo.sync_interval = pi_sync_interval;
     s->servo.reset = pi_reset;
+    s->servo.drop_phase = pi_drop_phase;
     s->drift = cfg->intial_adj;
     s->last_freq = cfg->intial_adj;
     s->kp = 0.0;
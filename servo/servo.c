@@ -3,6 +3,9 @@
  * @note Copyright (C) 2011 Richard Cochran <richardcochran@gmail.com>
  * @note SPDX-License-Identifier: GPL-2.0+
  */
+
+#define LOG_SUBSYS LOG_SUBSYS_SERVO
+
  
 #include <string.h>
 #include <stdlib.h>
@@ -14,6 +17,8 @@
 #include "servo.h"
 
 #include "logger.h"
+#include "probes.h"
+#include "trace.h"
 
 #define NSEC_PER_SEC 1000000000
 
@@ -100,7 +105,7 @@ servo_sample(struct servo* servo, int64_t offset, uint64_t local_ts, double weig
 {
     double r;
 
-    pr_debug("offset: %ld local_ts: %lu, weight: %f", offset, local_ts, weight);
+    trace_debug("offset: %ld local_ts: %lu, weight: %f", offset, local_ts, weight);
     r = servo->sample(servo, offset, local_ts, weight, state);
 
     switch (*state) {
@@ -126,6 +131,12 @@ servo_sample(struct servo* servo, int64_t offset, uint64_t local_ts, double weig
         break;
     }
 
+    PROBE3(servo_sample, offset, (int64_t)(r * 1e3), *state);
+    if (*state != servo->state) {
+        PROBE3(servo_state, servo->state, *state, offset);
+        servo->state = *state;
+    }
+
     return r;
 }
 
@@ -135,6 +146,21 @@ servo_sync_interval(struct servo* servo, double interval)
     servo->sync_interval(servo, interval);
 }
 
+double
+servo_drop_phase(struct servo* servo, double adj)
+{
+    if (servo->drop_phase)
+        return servo->drop_phase(servo);
+
+    return adj;
+}
+
+void
+servo_actuation_delay(struct servo* servo, int64_t delay)
+{
+    servo->actuation_delay = delay > 0 ? delay : 0;
+}
+
 void
 servo_reset(struct servo* servo)
 {
@@ -56,6 +56,10 @@ struct servo
     int64_t offset_threshold;
     int num_offset_values;
     int curr_offset_values;
+    /*! State returned by the previous sample. */
+    enum servo_state state;
+    /*! Time from the sample to the frequency update [ns], 0 if unknown. */
+    int64_t actuation_delay;
 
     void (*destroy)(struct servo* servo);
     double (*sample)(struct servo* servo, int64_t offset, uint64_t local_ts, double weight, enum servo_state* state);
@@ -63,6 +67,7 @@ struct servo
     void (*reset)(struct servo* servo);
     double (*rate_ratio)(struct servo* servo);
     void (*leap)(struct servo* servo, int leap);
+    double (*drop_phase)(struct servo* servo);
 };
 
 extern double
@@ -80,4 +85,29 @@ servo_destroy(struct servo* servo);
 extern void
 servo_sync_interval(struct servo* servo, double interval);
 
+/**
+ * @brief Drop the phase correction from the output of the last sample,
+ *        when the phase is corrected elsewhere.
+ *
+ * The servo continues from its frequency estimate as if that had been
+ * returned by the sample.
+ *
+ * @param [in] servo Servo.
+ * @param [in] adj Output of the last sample, kept by servos without a
+ *                 separate frequency estimate.
+ * @return Frequency adjustment without the phase correction [ppb].
+ */
+extern double
+servo_drop_phase(struct servo* servo, double adj);
+
+/**
+ * @brief Tell the servo how long after the sample time stamp its frequency
+ *        takes effect.
+ *
+ * @param [in] servo Servo.
+ * @param [in] delay Delay [ns], 0 to assume the update at the time stamp.
+ */
+extern void
+servo_actuation_delay(struct servo* servo, int64_t delay);
+
 #endif /* __SERVO_H__ */
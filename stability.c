@@ -0,0 +1,116 @@
+/**
+ * @file stability.c
+ * @note Copyright (C) 2022 SyncMonk Technologies <services@syncmonk.net>
+ * @note SPDX-License-Identifier: GPL-2.0+
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "stability.h"
+/******************************************************************************
+ * Local Definitions
+ *****************************************************************************/
+struct stab_block
+{
+    double x;
+    double y;
+    double min;
+    double max;
+};
+
+struct stab_level
+{
+    /*! Blocks received. */
+    uint64_t blocks;
+    /*! Last two blocks, hist[0] is the most recent. */
+    struct stab_block hist[2];
+    /*! First half of the next parent block. */
+    struct stab_block half;
+    int have_half;
+    double tdev_sum;
+    uint64_t tdev_n;
+    double adev_sum;
+    uint64_t adev_n;
+    double mtie;
+};
+
+static struct stab_level levels[STAB_LEVELS];
+static double stab_tau0 = 1.0;
+
+/******************************************************************************
+ * Local Functions
+ *****************************************************************************/
+static void
+level_push(struct stab_level* l, const struct stab_block* b)
+{
+    double d;
+
+    if (l->blocks >= 2) {
+        d = b->x - 2 * l->hist[0].x + l->hist[1].x;
+        l->tdev_sum += d * d;
+        l->tdev_n++;
+    }
+    if (l->blocks >= 1) {
+        d = b->y - l->hist[0].y;
+        l->adev_sum += d * d;
+        l->adev_n++;
+        d = fmax(b->max, l->hist[0].max) - fmin(b->min, l->hist[0].min);
+        if (d > l->mtie) {
+            l->mtie = d;
+        }
+    }
+    l->hist[1] = l->hist[0];
+    l->hist[0] = *b;
+    l->blocks++;
+}
+
+/******************************************************************************
+ * Public Functions
+ *****************************************************************************/
+void
+stab_init(double tau0)
+{
+    memset(levels, 0, sizeof(levels));
+    stab_tau0 = tau0;
+}
+
+void
+stab_sample(double x, double y)
+{
+    struct stab_block b = { .x = x, .y = y * 1e-9, .min = x, .max = x };
+    struct stab_level* l;
+    int k;
+
+    for (k = 0; k < STAB_LEVELS; k++) {
+        l = &levels[k];
+        level_push(l, &b);
+        if (!l->have_half) {
+            l->half = b;
+            l->have_half = 1;
+            return;
+        }
+        /* Two blocks make one block of the next level. */
+        b.x = (l->half.x + b.x) / 2;
+        b.y = (l->half.y + b.y) / 2;
+        b.min = fmin(l->half.min, b.min);
+        b.max = fmax(l->half.max, b.max);
+        l->have_half = 0;
+    }
+}
+
+int
+stab_get(int level, struct stab_result* res)
+{
+    struct stab_level* l;
+
+    if (level < 0 || level >= STAB_LEVELS || !levels[level].blocks) {
+        return -1;
+    }
+    l = &levels[level];
+    res->tau = stab_tau0 * (1ULL << level);
+    res->tdev = l->tdev_n ? sqrt(l->tdev_sum / (6.0 * l->tdev_n)) : -1.0;
+    res->adev = l->adev_n ? sqrt(l->adev_sum / (2.0 * l->adev_n)) : -1.0;
+    res->mtie = l->adev_n ? l->mtie : -1.0;
+    return 0;
+}
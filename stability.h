@@ -0,0 +1,75 @@
+/**
+ * @file stability.h
+ * @brief Streaming time error and frequency stability statistics.
+ * @note Copyright (C) 2022 SyncMonk Technologies <services@syncmonk.net>
+ * @note SPDX-License-Identifier: GPL-2.0+
+ *
+ * Samples arrive every tau0. Level k of a decimating pyramid receives the
+ * averages, minimum and maximum of consecutive blocks of 2^k samples, so
+ * the statistics are available for the octave set tau = 2^k * tau0. Each
+ * level keeps the last two blocks and one half of the next parent block,
+ * memory is logarithmic in the longest tau and a sample costs two level
+ * updates on average.
+ *
+ * Per level, over consecutive blocks with averages X (time error) and
+ * Y (fractional frequency):
+ *
+ *   TDEV^2 = < (X[b+2] - 2 X[b+1] + X[b])^2 > / 6
+ *   ADEV^2 = < (Y[b+1] - Y[b])^2 > / 2
+ *   MTIE   = max over adjacent block pairs of (max - min)
+ *
+ * MTIE over block pairs never falls below the sliding window MTIE at the
+ * same tau, so it is a conservative estimate.
+ */
+
+#ifndef __STABILITY_H__
+#define __STABILITY_H__
+
+#include <stdint.h>
+
+/*! Number of octave levels, the longest tau is 2^(STAB_LEVELS - 1) tau0. */
+#define STAB_LEVELS 20
+
+/**
+ * @brief Statistics of one tau.
+ */
+struct stab_result
+{
+    /*! Observation interval [s]. */
+    double tau;
+    /*! Time deviation [ns], negative until enough samples. */
+    double tdev;
+    /*! Allan deviation, negative until enough samples. */
+    double adev;
+    /*! Maximum time interval error [ns], negative until enough samples. */
+    double mtie;
+};
+
+/**
+ * @brief Reset all statistics.
+ *
+ * @param [in] tau0 Sample interval [s].
+ */
+void
+stab_init(double tau0);
+
+/**
+ * @brief Add one sample, amortized constant time.
+ *
+ * @param [in] x Time error [ns].
+ * @param [in] y Frequency [ppb].
+ */
+void
+stab_sample(double x, double y);
+
+/**
+ * @brief Get the statistics of one tau.
+ *
+ * @param [in] level Octave level, tau = 2^level * tau0.
+ * @param [out] res Statistics.
+ * @return 0 if the level has received a block, -1 otherwise.
+ */
+int
+stab_get(int level, struct stab_result* res);
+
+#endif /* __STABILITY_H__ */
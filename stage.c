@@ -0,0 +1,157 @@
+/**
+ * @file stage.c
+ * @note Copyright (C) 2022 SyncMonk Technologies <services@syncmonk.net>
+ * @note SPDX-License-Identifier: GPL-2.0+
+ */
+
+#include <inttypes.h>
+
+#include "logger.h"
+#include "metrics.h"
+#include "stage.h"
+#ifdef STAGE_HAVE_TSC
+#include <cpuid.h>
+#endif
+/******************************************************************************
+ * Local Definitions
+ *****************************************************************************/
+/*! Duration of the TSC calibration against CLOCK_MONOTONIC_RAW. */
+#define STAGE_CALIBRATION_NS 20000000
+
+uint64_t stage_stamps[STAGE_MAX];
+int stage_use_tsc;
+
+static double ns_per_tick = 1.0;
+static const char* stage_names[STAGE_MAX] = { "total", "recv", "parse", "tsproc", "servo", "adjust" };
+
+/* Slowest sample since the last dump, index STAGE_POLL holds the total. */
+static uint64_t worst[STAGE_MAX];
+
+/******************************************************************************
+ * Local Functions
+ *****************************************************************************/
+static inline uint64_t
+to_ns(uint64_t ticks)
+{
+    return stage_use_tsc ? ticks * ns_per_tick : ticks;
+}
+
+#ifdef STAGE_HAVE_TSC
+static int
+tsc_invariant()
+{
+    unsigned int eax, ebx, ecx, edx;
+
+    if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx)) {
+        return 0;
+    }
+    return (edx >> 8) & 1;
+}
+
+static uint64_t
+raw_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void
+tsc_calibrate()
+{
+    struct timespec interval = { 0, STAGE_CALIBRATION_NS };
+    uint64_t t0, t1, c0, c1;
+
+    t0 = raw_ns();
+    c0 = __rdtsc();
+    nanosleep(&interval, NULL);
+    c1 = __rdtsc();
+    t1 = raw_ns();
+    ns_per_tick = (double)(t1 - t0) / (c1 - c0);
+}
+#endif
+
+static void
+dump_hist(const char* name, enum metrics_hist id)
+{
+    const struct hdrhist* cur = &metrics_hist[id].cur;
+    const struct hdrhist* last = &metrics_hist[id].last;
+
+    pr_notice("%-6s %8" PRIu64 " %8" PRIu64 " %8" PRIu64 " %8" PRIu64 " | %8" PRIu64 " %8" PRIu64 " %8" PRIu64
+              " %8" PRIu64,
+              name,
+              hdrhist_quantile(cur, 0.5),
+              hdrhist_quantile(cur, 0.99),
+              cur->max,
+              cur->count,
+              hdrhist_quantile(last, 0.5),
+              hdrhist_quantile(last, 0.99),
+              last->max,
+              last->count);
+}
+
+/******************************************************************************
+ * Public Functions
+ *****************************************************************************/
+void
+stage_init()
+{
+#ifdef STAGE_HAVE_TSC
+    if (tsc_invariant()) {
+        tsc_calibrate();
+        stage_use_tsc = 1;
+        pr_info("stage timestamps: TSC at %.3f MHz", 1000.0 / ns_per_tick);
+        return;
+    }
+#endif
+    pr_info("stage timestamps: CLOCK_MONOTONIC_RAW");
+}
+
+void
+stage_end()
+{
+    uint64_t d[STAGE_MAX] = { 0 };
+    uint64_t prev = stage_stamps[STAGE_POLL];
+    int i;
+
+    for (i = STAGE_RECV; i < STAGE_MAX; i++) {
+        if (!stage_stamps[i]) {
+            continue;
+        }
+        d[i] = to_ns(stage_stamps[i] - prev);
+        prev = stage_stamps[i];
+        metrics_hist_record(METRICS_HIST_PROCESSING + i, d[i]);
+    }
+    d[STAGE_POLL] = to_ns(prev - stage_stamps[STAGE_POLL]);
+    metrics_latency(d[STAGE_POLL]);
+    metrics_hist_record(METRICS_HIST_PROCESSING, d[STAGE_POLL]);
+
+    if (d[STAGE_POLL] > worst[STAGE_POLL]) {
+        memcpy(worst, d, sizeof(worst));
+    }
+}
+
+void
+stage_dump()
+{
+    int i;
+
+    pr_notice("stage latency [ns], %s, current | last interval",
+              stage_use_tsc ? "TSC" : "CLOCK_MONOTONIC_RAW");
+    pr_notice("%-6s %8s %8s %8s %8s | %8s %8s %8s %8s", "stage", "p50", "p99", "max", "count", "p50", "p99", "max", "count");
+    for (i = STAGE_RECV; i < STAGE_MAX; i++) {
+        dump_hist(stage_names[i], METRICS_HIST_PROCESSING + i);
+    }
+    dump_hist(stage_names[STAGE_POLL], METRICS_HIST_PROCESSING);
+
+    pr_notice("slowest sample since last dump: total %" PRIu64 " recv %" PRIu64 " parse %" PRIu64 " tsproc %" PRIu64
+              " servo %" PRIu64 " adjust %" PRIu64,
+              worst[STAGE_POLL],
+              worst[STAGE_RECV],
+              worst[STAGE_PARSE],
+              worst[STAGE_TSPROC],
+              worst[STAGE_SERVO],
+              worst[STAGE_ADJUST]);
+    memset(worst, 0, sizeof(worst));
+}
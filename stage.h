@@ -0,0 +1,109 @@
+/**
+ * @file stage.h
+ * @brief Stage boundary timestamps of the sample path.
+ * @note Copyright (C) 2022 SyncMonk Technologies <services@syncmonk.net>
+ * @note SPDX-License-Identifier: GPL-2.0+
+ *
+ * Every datagram gets a timestamp at each stage boundary. On x86 with an
+ * invariant TSC the time stamp counter is read directly, otherwise
+ * CLOCK_MONOTONIC_RAW. Ticks are converted to nanoseconds only once the
+ * sample is complete, then each stage is recorded into its metrics
+ * histogram.
+ */
+
+#ifndef __STAGE_H__
+#define __STAGE_H__
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define STAGE_HAVE_TSC 1
+#endif
+
+/**
+ * @brief Stage boundaries, in the order of the sample path.
+ *
+ * The stage ending at a boundary is named after the boundary.
+ */
+enum stage
+{
+    /*! poll() returned. */
+    STAGE_POLL,
+    /*! uds_recv() returned. */
+    STAGE_RECV,
+    /*! process_message() returned. */
+    STAGE_PARSE,
+    /*! tsproc_update_offset() or tsproc_update_delay() returned. */
+    STAGE_TSPROC,
+    /*! servo_sample() returned. */
+    STAGE_SERVO,
+    /*! The last clockadj_*() call returned. */
+    STAGE_ADJUST,
+    STAGE_MAX,
+};
+
+/*! Timestamps of the current sample, 0 for boundaries not reached. */
+extern uint64_t stage_stamps[STAGE_MAX];
+/*! Set when the TSC is used. */
+extern int stage_use_tsc;
+
+static inline uint64_t
+stage_now()
+{
+    struct timespec ts;
+
+#ifdef STAGE_HAVE_TSC
+    if (stage_use_tsc) {
+        return __rdtsc();
+    }
+#endif
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * @brief Timestamp a stage boundary of the current sample.
+ *
+ * @param [in] s Stage boundary.
+ */
+static inline void
+stage_mark(enum stage s)
+{
+    stage_stamps[s] = stage_now();
+}
+
+/**
+ * @brief Start a new sample at the poll() wakeup.
+ */
+static inline void
+stage_begin()
+{
+    memset(stage_stamps, 0, sizeof(stage_stamps));
+    stage_mark(STAGE_POLL);
+}
+
+/**
+ * @brief Select the timestamp source, calibrating the TSC if used.
+ */
+void
+stage_init();
+
+/**
+ * @brief Account the current sample.
+ *
+ * Records the duration of every reached stage and the total since the
+ * poll() wakeup, and keeps the stage breakdown of the slowest sample.
+ */
+void
+stage_end();
+
+/**
+ * @brief Log per stage statistics and the slowest sample since the last
+ * dump.
+ */
+void
+stage_dump();
+
+#endif /* __STAGE_H__ */
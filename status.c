@@ -0,0 +1,128 @@
+/**
+ * @file status.c
+ * @note Copyright (C) 2022 SyncMonk Technologies <services@syncmonk.net>
+ * @note SPDX-License-Identifier: GPL-2.0+
+ */
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "logger.h"
+#include "metrics.h"
+#include "outlier.h"
+#include "servo.h"
+#include "status.h"
+/******************************************************************************
+ * Local Definitions
+ *****************************************************************************/
+static struct status_page* page;
+static struct status_data status;
+static char shm_name[MAX_CONFIG_STR_LEN];
+static uint64_t interval_ns;
+static uint64_t last_sync_ns;
+static uint64_t last_syncs;
+
+/******************************************************************************
+ * Public Functions
+ *****************************************************************************/
+int
+status_open(const char* name, double sync_interval)
+{
+    void* map;
+    int fd;
+
+    fd = shm_open(name, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        pr_err("status: cannot open %s: %m", name);
+        return -1;
+    }
+    if (ftruncate(fd, sizeof(*page))) {
+        pr_err("status: cannot size %s: %m", name);
+        close(fd);
+        return -1;
+    }
+    map = mmap(NULL, sizeof(*page), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        pr_err("status: cannot map %s: %m", name);
+        return -1;
+    }
+
+    page = map;
+    memset(page, 0, sizeof(*page));
+    memset(&status, 0, sizeof(status));
+    page->version = STATUS_VERSION;
+    page->size = sizeof(*page);
+    page->pid = getpid();
+    __atomic_store_n(&page->magic, STATUS_MAGIC, __ATOMIC_RELEASE);
+
+    strncpy(shm_name, name, sizeof(shm_name) - 1);
+    interval_ns = sync_interval * 1e9;
+    last_sync_ns = last_syncs = 0;
+    return 0;
+}
+
+void
+status_close()
+{
+    if (!page) {
+        return;
+    }
+    munmap(page, sizeof(*page));
+    shm_unlink(shm_name);
+    page = NULL;
+}
+
+void
+status_publish(uint64_t now_ns)
+{
+    struct outlier_stats delay, offset;
+    struct metrics_counters sum;
+    uint64_t gap;
+    int i;
+
+    if (!page) {
+        return;
+    }
+    /* Totals over all threads, the same values as the scrape. */
+    metrics_sum(&sum);
+
+    /* A sync interval more than 1.5 times too long means missing syncs. */
+    if (sum.rx[METRICS_TLV_SYNC] != last_syncs) {
+        gap = now_ns - last_sync_ns;
+        if (last_sync_ns && interval_ns && 2 * gap > 3 * interval_ns) {
+            status.missing += (gap + interval_ns / 2) / interval_ns - 1;
+        }
+        last_syncs = sum.rx[METRICS_TLV_SYNC];
+        last_sync_ns = now_ns;
+    }
+
+    status.servo_state = metrics_gauges.servo_state;
+    status.offset_ns = metrics_gauges.master_offset;
+    status.freq_ppb = metrics_gauges.freq_adj;
+    status.delay_ns = metrics_gauges.delay_filtered;
+    status.last_update_ns = now_ns;
+    if (status.servo_state == SERVO_LOCKED || status.servo_state == SERVO_LOCKED_STABLE) {
+        if (!status.locked_since_ns) {
+            status.locked_since_ns = now_ns;
+        }
+        status.lock_duration_ns = now_ns - status.locked_since_ns;
+    } else {
+        status.locked_since_ns = status.lock_duration_ns = 0;
+    }
+    status.steps = sum.steps;
+    status.samples = status.dropped = 0;
+    for (i = 0; i < METRICS_TLV_MAX; i++) {
+        status.samples += sum.rx[i];
+        status.dropped += sum.dropped[i];
+    }
+    metrics_outliers(&delay, &offset);
+    status.outliers_rejected = delay.rejected + offset.rejected;
+    status.outliers_weighted = delay.weighted + offset.weighted;
+
+    seqlock_write_begin(&page->seq);
+    page->data = status;
+    seqlock_write_end(&page->seq);
+}
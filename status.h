@@ -0,0 +1,110 @@
+/**
+ * @file status.h
+ * @brief Servo status page in POSIX shared memory.
+ * @note Copyright (C) 2022 SyncMonk Technologies <services@syncmonk.net>
+ * @note SPDX-License-Identifier: GPL-2.0+
+ *
+ * The page is updated after every datagram under a sequence counter
+ * (seqlock.h). Readers map the segment read only and copy the data with
+ * status_read(), they never block the daemon. The segment is removed when
+ * the daemon exits cleanly; a stale last_update_ns or a dead pid tells
+ * that it did not.
+ */
+
+#ifndef __STATUS_H__
+#define __STATUS_H__
+
+#include <stdint.h>
+
+#include "seqlock.h"
+
+#define STATUS_MAGIC 0x53545453 /* "STTS" */
+#define STATUS_VERSION 1
+
+/**
+ * @brief Status protected by the sequence counter.
+ */
+struct status_data
+{
+    /*! enum servo_state. */
+    int32_t servo_state;
+    uint32_t reserved;
+    /*! Last offset from the master [ns]. */
+    int64_t offset_ns;
+    /*! Last frequency adjustment [ppb]. */
+    double freq_ppb;
+    /*! Last filtered mean path delay [ns]. */
+    int64_t delay_ns;
+    /*! CLOCK_MONOTONIC time of the last update [ns]. */
+    uint64_t last_update_ns;
+    /*! CLOCK_MONOTONIC time the servo locked [ns], 0 while unlocked. */
+    uint64_t locked_since_ns;
+    /*! Time locked at the last update [ns]. */
+    uint64_t lock_duration_ns;
+    /*! Clock steps. */
+    uint64_t steps;
+    /*! Samples received. */
+    uint64_t samples;
+    /*! Samples which did not reach the servo. */
+    uint64_t dropped;
+    /*! Sync samples missing from the expected sync interval. */
+    uint64_t missing;
+    /*! Delay and offset samples rejected by the outlier detectors. */
+    uint64_t outliers_rejected;
+    /*! Delay and offset samples down-weighted by the outlier detectors. */
+    uint64_t outliers_weighted;
+};
+
+struct status_page
+{
+    uint32_t magic;
+    uint32_t version;
+    /*! Size of this structure. */
+    uint32_t size;
+    int32_t pid;
+    uint64_t seq;
+    struct status_data data;
+};
+
+/**
+ * @brief Copy a consistent snapshot of a status page.
+ *
+ * @param [in] page Mapped status page.
+ * @param [out] data Snapshot.
+ */
+static inline void
+status_read(const struct status_page* page, struct status_data* data)
+{
+    uint64_t seq;
+
+    do {
+        seq = seqlock_read_begin(&page->seq);
+        *data = page->data;
+    } while (seqlock_read_retry(&page->seq, seq));
+}
+
+/**
+ * @brief Create and map the status page.
+ *
+ * @param [in] name POSIX shared memory name, e.g. "/ext_servo".
+ * @param [in] sync_interval Expected sync interval [s].
+ * @return 0 on success, -1 otherwise.
+ */
+int
+status_open(const char* name, double sync_interval);
+
+/**
+ * @brief Unmap and remove the status page.
+ */
+void
+status_close();
+
+/**
+ * @brief Publish the current servo status.
+ *
+ * @param [in] now_ns CLOCK_MONOTONIC time [ns].
+ */
+void
+status_publish(uint64_t now_ns);
+
+#endif /* __STATUS_H__ */
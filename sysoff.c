@@ -0,0 +1,167 @@
+/**
+ * @file sysoff.c
+ * @note Copyright (C) 2022 SyncMonk Technologies <services@syncmonk.net>
+ * @note SPDX-License-Identifier: GPL-2.0+
+ */
+
+#define LOG_SUBSYS LOG_SUBSYS_CLOCKADJ
+
+#include <errno.h>
+#include <string.h>
+#include <sys/ioctl.h>
+
+#include "clockadj.h"
+#include "logger.h"
+#include "missing.h"
+#include "sysoff.h"
+/******************************************************************************
+ * Local Definitions
+ *****************************************************************************/
+#define NS_PER_SEC 1000000000LL
+
+static const char* method_names[] = {
+    [SYSOFF_PRECISE] = "precise",
+    [SYSOFF_EXTENDED] = "extended",
+    [SYSOFF_BASIC] = "basic",
+    [SYSOFF_COMPARE] = "compare",
+};
+
+/******************************************************************************
+ * Local Functions
+ *****************************************************************************/
+static inline int64_t
+pctns(const struct ptp_clock_time* t)
+{
+    return t->sec * NS_PER_SEC + t->nsec;
+}
+
+static int
+measure_precise(int fd, int64_t* offset, uint64_t* ts, int64_t* delay)
+{
+    struct ptp_sys_offset_precise pso;
+
+    memset(&pso, 0, sizeof(pso));
+    if (ioctl(fd, PTP_SYS_OFFSET_PRECISE, &pso)) {
+        return -1;
+    }
+    *offset = pctns(&pso.sys_realtime) - pctns(&pso.device);
+    *ts = pctns(&pso.sys_realtime);
+    *delay = 0;
+    return 0;
+}
+
+static int
+measure_extended(int fd, int n, int64_t* offset, uint64_t* ts, int64_t* delay)
+{
+    struct ptp_sys_offset_extended pso;
+    int64_t t1, t2, interval, best = INT64_MAX;
+    int i;
+
+    memset(&pso, 0, sizeof(pso));
+    pso.n_samples = n;
+    if (ioctl(fd, PTP_SYS_OFFSET_EXTENDED, &pso)) {
+        return -1;
+    }
+    for (i = 0; i < n; i++) {
+        t1 = pctns(&pso.ts[i][0]);
+        t2 = pctns(&pso.ts[i][2]);
+        interval = t2 - t1;
+        if (interval < best) {
+            best = interval;
+            *offset = t1 + interval / 2 - pctns(&pso.ts[i][1]);
+            *ts = t2;
+        }
+    }
+    *delay = best;
+    return 0;
+}
+
+static int
+measure_basic(int fd, int n, int64_t* offset, uint64_t* ts, int64_t* delay)
+{
+    struct ptp_sys_offset pso;
+    int64_t t1, t2, interval, best = INT64_MAX;
+    int i;
+
+    memset(&pso, 0, sizeof(pso));
+    pso.n_samples = n;
+    if (ioctl(fd, PTP_SYS_OFFSET, &pso)) {
+        return -1;
+    }
+    /* System and PHC readings interleaved, system time first and last. */
+    for (i = 0; i < n; i++) {
+        t1 = pctns(&pso.ts[2 * i]);
+        t2 = pctns(&pso.ts[2 * i + 2]);
+        interval = t2 - t1;
+        if (interval < best) {
+            best = interval;
+            *offset = t1 + interval / 2 - pctns(&pso.ts[2 * i + 1]);
+            *ts = t2;
+        }
+    }
+    *delay = best;
+    return 0;
+}
+
+/******************************************************************************
+ * Public Functions
+ *****************************************************************************/
+enum sysoff_method
+sysoff_probe(clockid_t clkid)
+{
+    int64_t offset, delay;
+    uint64_t ts;
+    int fd;
+
+    if (clkid == CLOCK_REALTIME) {
+        return SYSOFF_COMPARE;
+    }
+    fd = CLOCKID_TO_FD(clkid);
+    if (!measure_precise(fd, &offset, &ts, &delay)) {
+        return SYSOFF_PRECISE;
+    }
+    if (!measure_extended(fd, 1, &offset, &ts, &delay)) {
+        return SYSOFF_EXTENDED;
+    }
+    if (!measure_basic(fd, 1, &offset, &ts, &delay)) {
+        return SYSOFF_BASIC;
+    }
+    return SYSOFF_COMPARE;
+}
+
+const char*
+sysoff_method_name(enum sysoff_method method)
+{
+    return method_names[method];
+}
+
+int
+sysoff_measure(clockid_t clkid, enum sysoff_method method, int n, int64_t* offset, uint64_t* ts, int64_t* delay)
+{
+    int fd = CLOCKID_TO_FD(clkid);
+    int rv;
+
+    if (n < 1) {
+        n = 1;
+    } else if (n > PTP_MAX_SAMPLES) {
+        n = PTP_MAX_SAMPLES;
+    }
+    switch (method) {
+    case SYSOFF_PRECISE:
+        rv = measure_precise(fd, offset, ts, delay);
+        break;
+    case SYSOFF_EXTENDED:
+        rv = measure_extended(fd, n, offset, ts, delay);
+        break;
+    case SYSOFF_BASIC:
+        rv = measure_basic(fd, n, offset, ts, delay);
+        break;
+    default:
+        rv = clockadj_compare(clkid, CLOCK_REALTIME, n, offset, ts, delay) ? -1 : 0;
+        break;
+    }
+    if (rv) {
+        pr_err("failed to cross timestamp the clock (%s): %m", method_names[method]);
+    }
+    return rv;
+}
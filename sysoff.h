@@ -0,0 +1,62 @@
+/**
+ * @file sysoff.h
+ * @brief Cross timestamping of a PHC against the system clock.
+ * @note Copyright (C) 2022 SyncMonk Technologies <services@syncmonk.net>
+ * @note SPDX-License-Identifier: GPL-2.0+
+ *
+ * The most precise method the driver supports is used:
+ *
+ *   precise   PTP_SYS_OFFSET_PRECISE, a hardware cross timestamp
+ *   extended  PTP_SYS_OFFSET_EXTENDED, system time read right around the
+ *             PHC register access
+ *   basic     PTP_SYS_OFFSET, system time read around the whole driver call
+ *   compare   clock_gettime() of both clocks, see clockadj_compare()
+ *
+ * Except for precise, the reading with the shortest system time window
+ * out of n is taken, its midpoint is the system time of the PHC reading.
+ */
+
+#ifndef __SYSOFF_H__
+#define __SYSOFF_H__
+
+#include <stdint.h>
+#include <time.h>
+
+enum sysoff_method
+{
+    SYSOFF_PRECISE,
+    SYSOFF_EXTENDED,
+    SYSOFF_BASIC,
+    SYSOFF_COMPARE,
+};
+
+/**
+ * @brief Find the most precise method supported by a clock.
+ *
+ * @param [in] clkid PHC, CLOCK_REALTIME gives SYSOFF_COMPARE.
+ * @return The method.
+ */
+enum sysoff_method
+sysoff_probe(clockid_t clkid);
+
+/**
+ * @brief Name of a method.
+ */
+const char*
+sysoff_method_name(enum sysoff_method method);
+
+/**
+ * @brief Measure the offset of the system clock from a PHC.
+ *
+ * @param [in] clkid PHC.
+ * @param [in] method Method from sysoff_probe().
+ * @param [in] n Readings, at most PTP_MAX_SAMPLES.
+ * @param [out] offset CLOCK_REALTIME minus PHC time [ns].
+ * @param [out] ts CLOCK_REALTIME of the measurement [ns].
+ * @param [out] delay Width of the system time window, 0 for precise [ns].
+ * @return 0 on success, -1 otherwise.
+ */
+int
+sysoff_measure(clockid_t clkid, enum sysoff_method method, int n, int64_t* offset, uint64_t* ts, int64_t* delay);
+
+#endif /* __SYSOFF_H__ */
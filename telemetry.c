@@ -0,0 +1,94 @@
+/**
+ * @file telemetry.c
+ * @note Copyright (C) 2022 SyncMonk Technologies <services@syncmonk.net>
+ * @note SPDX-License-Identifier: GPL-2.0+
+ */
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "logger.h"
+#include "seqlock.h"
+#include "telemetry.h"
+/******************************************************************************
+ * Local Definitions
+ *****************************************************************************/
+struct telemetry_header* telemetry_ring;
+
+static struct telemetry_record* records;
+static size_t map_size;
+
+/******************************************************************************
+ * Public Functions
+ *****************************************************************************/
+int
+telemetry_open(const char* path, uint32_t count)
+{
+    struct telemetry_header* hdr;
+    uint64_t capacity;
+    void* map;
+    int fd;
+
+    for (capacity = 1; capacity < (count ? count : TELEMETRY_RECORDS); capacity <<= 1)
+        ;
+    map_size = sizeof(*hdr) + capacity * sizeof(struct telemetry_record);
+
+    fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        pr_err("telemetry: cannot open %s: %m", path);
+        return -1;
+    }
+    if (ftruncate(fd, map_size)) {
+        pr_err("telemetry: cannot size %s: %m", path);
+        close(fd);
+        return -1;
+    }
+    map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        pr_err("telemetry: cannot map %s: %m", path);
+        return -1;
+    }
+    /* Allocate every page now rather than on the sample path. */
+    memset(map, 0, map_size);
+
+    hdr = map;
+    hdr->version = TELEMETRY_VERSION;
+    hdr->header_size = sizeof(*hdr);
+    hdr->record_size = sizeof(struct telemetry_record);
+    hdr->capacity = capacity;
+    records = (struct telemetry_record*)((char*)map + sizeof(*hdr));
+    /* Readers check the magic last. */
+    __atomic_store_n(&hdr->magic, TELEMETRY_MAGIC, __ATOMIC_RELEASE);
+    telemetry_ring = hdr;
+    pr_info("telemetry: %lu records in %s", (unsigned long)capacity, path);
+    return 0;
+}
+
+void
+telemetry_close()
+{
+    if (!telemetry_ring) {
+        return;
+    }
+    munmap(telemetry_ring, map_size);
+    telemetry_ring = NULL;
+    records = NULL;
+}
+
+void
+telemetry_publish(const struct telemetry_record* rec)
+{
+    uint64_t head = telemetry_ring->head;
+    struct telemetry_record* slot = &records[head & (telemetry_ring->capacity - 1)];
+
+    seqlock_write_begin(&slot->seq);
+    memcpy((char*)slot + offsetof(struct telemetry_record, t1),
+           (const char*)rec + offsetof(struct telemetry_record, t1),
+           sizeof(*rec) - offsetof(struct telemetry_record, t1));
+    seqlock_write_end(&slot->seq);
+    __atomic_store_n(&telemetry_ring->head, head + 1, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,110 @@
+/**
+ * @file telemetry.h
+ * @brief Memory mapped ring of per sample servo data.
+ * @note Copyright (C) 2022 SyncMonk Technologies <services@syncmonk.net>
+ * @note SPDX-License-Identifier: GPL-2.0+
+ *
+ * File layout, all fields in host byte order:
+ *
+ *   offset 0               struct telemetry_header
+ *   offset header_size     capacity x struct telemetry_record
+ *
+ * Record n (counting from 0 since the daemon started) is stored in slot
+ * n % capacity. The header field head is the number of records published.
+ * A record is written under its own sequence counter (seqlock.h), which
+ * the writer increments by 2 per write of the slot. Record n is therefore
+ * complete and intact when seq == 2 * (n / capacity + 1) both before and
+ * after it is copied. A reader tails the ring as follows:
+ *
+ *   - load head (acquire);
+ *   - if head - next > capacity, records were overwritten, continue at
+ *     head - capacity;
+ *   - copy records next .. head - 1, checking seq as described above.
+ *
+ * One record is written per offset sample that reaches the servo.
+ * Place the file on tmpfs (e.g. /dev/shm) to keep page writeback away.
+ */
+
+#ifndef __TELEMETRY_H__
+#define __TELEMETRY_H__
+
+#include <stdint.h>
+
+#define TELEMETRY_MAGIC 0x4d4c4554 /* "TELM" */
+#define TELEMETRY_VERSION 1
+/*! Default number of records. */
+#define TELEMETRY_RECORDS 65536
+
+struct telemetry_header
+{
+    uint32_t magic;
+    uint32_t version;
+    /*! Offset of the first record. */
+    uint32_t header_size;
+    /*! Size of one record, readers must step by this size. */
+    uint32_t record_size;
+    /*! Number of records, a power of 2. */
+    uint64_t capacity;
+    /*! Records published so far. */
+    uint64_t head;
+    uint8_t reserved[32];
+};
+
+struct telemetry_record
+{
+    /*! Sequence counter of the slot. */
+    uint64_t seq;
+    /*! Sync origin and ingress, delay request egress and ingress [ns]. */
+    int64_t t1;
+    int64_t t2;
+    int64_t t3;
+    int64_t t4;
+    /*! Offset from the master [ns]. */
+    int64_t offset;
+    /*! Filtered mean path delay [ns]. */
+    int64_t delay;
+    /*! Weight of the sample. */
+    double weight;
+    /*! Adjustment applied: frequency [ppb], phase [ns] in SERVO_LOCKED_STABLE. */
+    double adj;
+    /*! enum servo_state. */
+    int32_t state;
+    uint32_t reserved;
+};
+
+/*! Header of the mapped ring, NULL when disabled. */
+extern struct telemetry_header* telemetry_ring;
+
+/**
+ * @brief Create and map the ring file.
+ *
+ * All pages are touched here, publishing never page faults.
+ *
+ * @param [in] path Ring file, truncated if it exists.
+ * @param [in] records Number of records, rounded up to a power of 2.
+ * @return 0 on success, -1 otherwise.
+ */
+int
+telemetry_open(const char* path, uint32_t records);
+
+/**
+ * @brief Unmap the ring, the file is kept for post mortem analysis.
+ */
+void
+telemetry_close();
+
+/**
+ * @brief Publish one record.
+ *
+ * @param [in] rec Record, seq is ignored.
+ */
+void
+telemetry_publish(const struct telemetry_record* rec);
+
+static inline int
+telemetry_enabled()
+{
+    return telemetry_ring != NULL;
+}
+
+#endif /* __TELEMETRY_H__ */
@@ -0,0 +1,213 @@
+/**
+ * @file todsync.c
+ * @note Copyright (C) 2022 SyncMonk Technologies <services@syncmonk.net>
+ * @note SPDX-License-Identifier: GPL-2.0+
+ */
+
+#define _GNU_SOURCE
+#define LOG_SUBSYS LOG_SUBSYS_SERVO
+
+#include <inttypes.h>
+#include <linux/futex.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "clockadj.h"
+#include "logger.h"
+#include "metrics.h"
+#include "seqlock.h"
+#include "servo.h"
+#include "sysoff.h"
+#include "todsync.h"
+#include "trace.h"
+/******************************************************************************
+ * Local Definitions
+ *****************************************************************************/
+#define NS_PER_SEC 1000000000LL
+
+static struct
+{
+    clockid_t tod;
+    clockid_t ref;
+    enum sysoff_method tod_method;
+    enum sysoff_method ref_method;
+    uint64_t interval_ns;
+    int readings;
+    struct servo* servo;
+    pthread_t thread;
+    int running;
+    /* Futex word, set to stop the loop. */
+    uint32_t stop;
+    /* Seqlock of the status, read by the metrics thread. */
+    uint64_t seq;
+    struct todsync_status status;
+} tds;
+
+/******************************************************************************
+ * Local Functions
+ *****************************************************************************/
+static inline uint64_t
+now_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * NS_PER_SEC + ts.tv_nsec;
+}
+
+/*
+ * TOD device minus reference. The two readings are a few microseconds
+ * apart, the system clock drifts picoseconds in between.
+ */
+static int
+measure(int64_t* offset, uint64_t* ts, int64_t* delay)
+{
+    int64_t tod_offset, ref_offset = 0, ref_delay = 0;
+    uint64_t ref_ts;
+
+    if (sysoff_measure(tds.tod, tds.tod_method, tds.readings, &tod_offset, ts, delay)) {
+        return -1;
+    }
+    if (tds.ref != CLOCK_REALTIME &&
+        sysoff_measure(tds.ref, tds.ref_method, tds.readings, &ref_offset, &ref_ts, &ref_delay)) {
+        return -1;
+    }
+    *offset = ref_offset - tod_offset;
+    *delay += ref_delay;
+    return 0;
+}
+
+static void
+update(int64_t offset, uint64_t ts, int64_t delay)
+{
+    enum servo_state state = SERVO_UNLOCKED;
+    int stepped = 0;
+    double adj;
+
+    adj = servo_sample(tds.servo, offset, ts, 1.0, &state);
+    switch (state) {
+    case SERVO_UNLOCKED:
+        break;
+    case SERVO_JUMP:
+        clockadj_step(tds.tod, -offset);
+        clockadj_set_freq(tds.tod, -adj);
+        stepped = 1;
+        break;
+    case SERVO_LOCKED:
+    case SERVO_LOCKED_STABLE:
+        clockadj_set_freq(tds.tod, -adj);
+        break;
+    }
+    trace_debug("tod offset %" PRId64 " delay %" PRId64 " adj %f state %d", offset, delay, adj, state);
+
+    seqlock_write_begin(&tds.seq);
+    tds.status.offset = offset;
+    tds.status.delay = delay;
+    if (state != SERVO_UNLOCKED) {
+        tds.status.freq = -adj;
+    }
+    tds.status.state = state;
+    tds.status.steps += stepped;
+    seqlock_write_end(&tds.seq);
+}
+
+static void*
+todsync_loop(void* arg)
+{
+    uint64_t next = now_ns(), now, ts;
+    int64_t offset, delay;
+    struct timespec timeout;
+
+    metrics_register();
+    trace_register();
+    for (;;) {
+        next += tds.interval_ns;
+        now = now_ns();
+        if (next > now) {
+            timeout.tv_sec = (next - now) / NS_PER_SEC;
+            timeout.tv_nsec = (next - now) % NS_PER_SEC;
+            syscall(SYS_futex, &tds.stop, FUTEX_WAIT_PRIVATE, 0, &timeout, NULL, 0);
+        } else {
+            /* Overrun, start over from now. */
+            next = now;
+        }
+        if (__atomic_load_n(&tds.stop, __ATOMIC_ACQUIRE)) {
+            return NULL;
+        }
+        if (!measure(&offset, &ts, &delay)) {
+            update(offset, ts, delay);
+        }
+    }
+}
+
+/******************************************************************************
+ * Public Functions
+ *****************************************************************************/
+int
+todsync_start(clockid_t tod, clockid_t ref, const struct servo_config* config, uint32_t interval_ms, int readings)
+{
+    struct servo_config cfg = *config;
+
+    memset(&tds, 0, sizeof(tds));
+    tds.tod = tod;
+    tds.ref = ref;
+    tds.interval_ns = (interval_ms ? interval_ms : TODSYNC_DEF_INTERVAL_MS) * 1000000ULL;
+    tds.readings = readings ? readings : TODSYNC_DEF_READINGS;
+    tds.tod_method = sysoff_probe(tod);
+    tds.ref_method = sysoff_probe(ref);
+
+    /* The NTP SHM servo hands the offset to another daemon. */
+    if (cfg.type == NTP_SHM) {
+        cfg.type = PI_SERVO;
+    }
+    cfg.intial_adj = -clockadj_get_freq(tod);
+    tds.servo = servo_create(&cfg);
+    if (!tds.servo) {
+        pr_err("todsync: cannot create the servo");
+        return -1;
+    }
+    servo_sync_interval(tds.servo, tds.interval_ns / 1e9);
+
+    if (pthread_create(&tds.thread, NULL, todsync_loop, NULL)) {
+        pr_err("todsync: cannot create thread");
+        servo_destroy(tds.servo);
+        return -1;
+    }
+    pthread_setname_np(tds.thread, "ext_servo_tod");
+    tds.running = 1;
+    pr_info("todsync: TOD device cross timestamped every %" PRIu64 " ms, %s, reference %s",
+            tds.interval_ns / 1000000,
+            sysoff_method_name(tds.tod_method),
+            ref == CLOCK_REALTIME ? "CLOCK_REALTIME" : sysoff_method_name(tds.ref_method));
+    return 0;
+}
+
+void
+todsync_stop()
+{
+    if (!tds.running) {
+        return;
+    }
+    __atomic_store_n(&tds.stop, 1, __ATOMIC_RELEASE);
+    syscall(SYS_futex, &tds.stop, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+    pthread_join(tds.thread, NULL);
+    servo_destroy(tds.servo);
+    tds.running = 0;
+}
+
+int
+todsync_get(struct todsync_status* status)
+{
+    uint64_t seq;
+
+    if (!tds.running) {
+        return -1;
+    }
+    do {
+        seq = seqlock_read_begin(&tds.seq);
+        *status = tds.status;
+    } while (seqlock_read_retry(&tds.seq, seq));
+    return 0;
+}
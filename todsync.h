@@ -0,0 +1,76 @@
+/**
+ * @file todsync.h
+ * @brief Secondary loop keeping a separate TOD device on a reference clock.
+ * @note Copyright (C) 2022 SyncMonk Technologies <services@syncmonk.net>
+ * @note SPDX-License-Identifier: GPL-2.0+
+ *
+ * When tod_device and freq_device differ, a thread cross timestamps the TOD
+ * device against the reference, the frequency device or CLOCK_REALTIME,
+ * every interval and steers the TOD device with a servo of its own. Both
+ * PHCs are measured against CLOCK_REALTIME with sysoff_measure() right
+ * after another, the system clock cancels out of the difference.
+ *
+ * The main servo then steps the reference instead of the TOD device, time
+ * flows from the master to the reference and from there to the TOD device.
+ */
+
+#ifndef __TODSYNC_H__
+#define __TODSYNC_H__
+
+#include <stdint.h>
+#include <time.h>
+
+#include "config.h"
+
+/*! Default interval of the loop [ms]. */
+#define TODSYNC_DEF_INTERVAL_MS 250
+/*! Default readings per cross timestamp. */
+#define TODSYNC_DEF_READINGS 5
+
+/**
+ * @brief Last state of the loop.
+ */
+struct todsync_status
+{
+    /*! TOD device minus reference [ns]. */
+    int64_t offset;
+    /*! Width of the cross timestamp windows [ns]. */
+    int64_t delay;
+    /*! Frequency of the TOD device [ppb]. */
+    double freq;
+    /*! Servo state. */
+    int state;
+    /*! Steps of the TOD device. */
+    uint64_t steps;
+};
+
+/**
+ * @brief Start the loop.
+ *
+ * @param [in] tod TOD device.
+ * @param [in] ref Reference, a PHC or CLOCK_REALTIME.
+ * @param [in] config Servo configuration, copied. max_frequency is the one
+ *                    of the TOD device.
+ * @param [in] interval_ms Loop interval, 0 for the default.
+ * @param [in] readings Readings per cross timestamp, 0 for the default.
+ * @return 0 on success, -1 otherwise.
+ */
+int
+todsync_start(clockid_t tod, clockid_t ref, const struct servo_config* config, uint32_t interval_ms, int readings);
+
+/**
+ * @brief Stop the loop and destroy its servo.
+ */
+void
+todsync_stop();
+
+/**
+ * @brief Read the last state of the loop.
+ *
+ * @param [out] status State.
+ * @return 0 on success, -1 if the loop is not running.
+ */
+int
+todsync_get(struct todsync_status* status);
+
+#endif /* __TODSYNC_H__ */
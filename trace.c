@@ -0,0 +1,252 @@
+/**
+ * @file trace.c
+ * @note Copyright (C) 2022 SyncMonk Technologies <services@syncmonk.net>
+ * @note SPDX-License-Identifier: GPL-2.0+
+ */
+
+#define _GNU_SOURCE
+#include <inttypes.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "trace.h"
+/******************************************************************************
+ * Local Definitions
+ *****************************************************************************/
+/*! Sleep of the drain thread between two passes over the rings. */
+#define TRACE_DRAIN_INTERVAL_NS 10000000
+#define TRACE_MAX_SPEC_LEN 32
+#define TRACE_LINE_LEN 1024
+
+/* Shared by the threads without a ring, head - tail > mask keeps it full. */
+static struct trace_ring lost_ring = { .head = 1 };
+
+int trace_active;
+__thread struct trace_ring* trace_ring = &lost_ring;
+
+static struct trace_ring* rings;
+static pthread_mutex_t rings_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t drain_thread;
+static uint32_t ring_size;
+static int running;
+
+/******************************************************************************
+ * Local Functions
+ *****************************************************************************/
+static int
+is_int_conv(char c)
+{
+    return strchr("diouxX", c) != NULL;
+}
+
+static int
+is_double_conv(char c)
+{
+    return strchr("fFeEgGaA", c) != NULL;
+}
+
+/*
+ * Format one conversion, a missing argument is printed as "?". Integer
+ * arguments are always stored as 64 bit values, so length modifiers in the
+ * format are replaced by "ll".
+ */
+static int
+format_arg(char* buf, int len, const char* spec, int spec_len, char conv, const struct trace_arg* arg)
+{
+    char fmt[TRACE_MAX_SPEC_LEN];
+
+    if (!arg || spec_len > TRACE_MAX_SPEC_LEN - 4) {
+        return snprintf(buf, len, "?");
+    }
+    memcpy(fmt, spec, spec_len);
+
+    if (is_int_conv(conv)) {
+        memcpy(fmt + spec_len, "ll", 2);
+        fmt[spec_len + 2] = conv;
+        fmt[spec_len + 3] = '\0';
+        return snprintf(buf, len, fmt, arg->type == TRACE_ARG_DOUBLE ? (long long)arg->d : (long long)arg->i);
+    }
+
+    fmt[spec_len] = conv;
+    fmt[spec_len + 1] = '\0';
+    if (is_double_conv(conv)) {
+        return snprintf(buf, len, fmt, arg->type == TRACE_ARG_DOUBLE ? arg->d : (double)arg->i);
+    }
+    switch (conv) {
+    case 's':
+        return snprintf(buf, len, fmt, arg->type == TRACE_ARG_STR ? arg->s : "?");
+    case 'c':
+        return snprintf(buf, len, fmt, (int)arg->i);
+    case 'p':
+        return snprintf(buf, len, fmt, (void*)(intptr_t)arg->i);
+    default:
+        return snprintf(buf, len, "?");
+    }
+}
+
+static void
+drain_ring(struct trace_ring* ring)
+{
+    uint64_t head, tail, dropped;
+    struct trace_rec* rec;
+    char line[TRACE_LINE_LEN];
+    struct timespec ts;
+
+    tail = ring->tail;
+    head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    for (; tail != head; tail++) {
+        rec = &ring->recs[tail & ring->mask];
+        trace_format(rec, line, sizeof(line));
+        ts.tv_sec = rec->ts / 1000000000ULL;
+        ts.tv_nsec = rec->ts % 1000000000ULL;
+        logger_write(rec->fmt->level, rec->fmt->name, &ts, line);
+        __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+    }
+
+    dropped = __atomic_exchange_n(&ring->dropped, 0, __ATOMIC_RELAXED);
+    if (dropped) {
+        pr_warning("trace ring full, %" PRIu64 " records dropped", dropped);
+    }
+}
+
+static void
+drain_all()
+{
+    struct trace_ring* ring;
+
+    uint64_t dropped;
+
+    pthread_mutex_lock(&rings_lock);
+    for (ring = rings; ring; ring = ring->next) {
+        drain_ring(ring);
+    }
+    pthread_mutex_unlock(&rings_lock);
+
+    dropped = __atomic_exchange_n(&lost_ring.dropped, 0, __ATOMIC_RELAXED);
+    if (dropped) {
+        pr_warning("trace: %" PRIu64 " records of threads without a ring dropped", dropped);
+    }
+}
+
+static void*
+drain_loop(void* arg)
+{
+    struct timespec interval = { 0, TRACE_DRAIN_INTERVAL_NS };
+    struct sched_param param = { .sched_priority = 0 };
+
+    pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+
+    while (__atomic_load_n(&running, __ATOMIC_ACQUIRE)) {
+        drain_all();
+        nanosleep(&interval, NULL);
+    }
+    drain_all();
+    return NULL;
+}
+
+/******************************************************************************
+ * Public Functions
+ *****************************************************************************/
+int
+trace_register()
+{
+    struct trace_ring* ring;
+
+    if (!__atomic_load_n(&running, __ATOMIC_ACQUIRE) || trace_ring != &lost_ring) {
+        return 0;
+    }
+    ring = calloc(1, sizeof(*ring) + ring_size * sizeof(struct trace_rec));
+    if (!ring) {
+        pr_err("trace: cannot allocate the ring of a thread, its records are dropped");
+        return -1;
+    }
+    ring->mask = ring_size - 1;
+
+    pthread_mutex_lock(&rings_lock);
+    ring->next = rings;
+    rings = ring;
+    pthread_mutex_unlock(&rings_lock);
+
+    trace_ring = ring;
+    return 0;
+}
+
+int
+trace_start(uint32_t size)
+{
+    if (running || !size) {
+        return -1;
+    }
+    for (ring_size = 1; ring_size < size; ring_size <<= 1)
+        ;
+
+    running = 1;
+    if (pthread_create(&drain_thread, NULL, drain_loop, NULL)) {
+        running = 0;
+        return -1;
+    }
+    __atomic_store_n(&trace_active, 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+void
+trace_stop()
+{
+    if (!running) {
+        return;
+    }
+    __atomic_store_n(&trace_active, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&running, 0, __ATOMIC_RELEASE);
+    pthread_join(drain_thread, NULL);
+}
+
+void
+trace_format(const struct trace_rec* rec, char* buf, int len)
+{
+    const char* p = rec->fmt->format;
+    const char* spec;
+    uint32_t arg = 0;
+    int n = 0, rv;
+    char conv;
+
+    while (*p && n < len - 1) {
+        if (*p != '%') {
+            buf[n++] = *p++;
+            continue;
+        }
+        if (p[1] == '%') {
+            buf[n++] = '%';
+            p += 2;
+            continue;
+        }
+
+        /* Flags, width and precision are kept, length modifiers dropped. */
+        spec = p++;
+        while (*p && strchr("-+ #0123456789.", *p)) {
+            p++;
+        }
+        rv = p - spec;
+        while (*p && strchr("hlLqjzt", *p)) {
+            p++;
+        }
+        conv = *p;
+        if (!conv) {
+            break;
+        }
+        p++;
+
+        rv = format_arg(buf + n, len - n, spec, rv, conv, arg < rec->nargs ? &rec->args[arg] : NULL);
+        arg++;
+        if (rv < 0) {
+            break;
+        }
+        n += rv;
+        if (n > len - 1) {
+            n = len - 1;
+        }
+    }
+    buf[n] = '\0';
+}
@@ -0,0 +1,220 @@
+/**
+ * @file trace.h
+ * @brief Binary trace ring with deferred formatting.
+ * @note Copyright (C) 2022 SyncMonk Technologies <services@syncmonk.net>
+ * @note SPDX-License-Identifier: GPL-2.0+
+ *
+ * Tracepoints store a pointer to a static format descriptor, a timestamp
+ * and the raw arguments into a single producer / single consumer ring
+ * owned by the calling thread. A low priority thread drains all rings,
+ * formats the records and passes them to the logger.
+ *
+ * While the trace rings are not started, tracepoints call logger()
+ * directly, so they behave exactly like the pr_*() macros.
+ */
+
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <stdint.h>
+#include <time.h>
+
+#include "logger.h"
+
+/*! Maximum number of arguments of one tracepoint. */
+#define TRACE_MAX_ARGS 6
+
+#define TRACE_ARG_INT 0
+#define TRACE_ARG_DOUBLE 1
+#define TRACE_ARG_STR 2
+
+/**
+ * @brief Static description of a tracepoint, its address is the format ID.
+ */
+struct trace_fmt
+{
+    /*! printf() style format. */
+    const char* format;
+    /*! Level name reported in the log. */
+    char* name;
+    /*! Log level. */
+    int level;
+};
+
+/**
+ * @brief Raw tracepoint argument.
+ *
+ * Strings are stored by reference and must be static (literals, __func__).
+ */
+struct trace_arg
+{
+    uint8_t type;
+    union
+    {
+        int64_t i;
+        double d;
+        const char* s;
+    };
+};
+
+/**
+ * @brief One trace record.
+ */
+struct trace_rec
+{
+    const struct trace_fmt* fmt;
+    /*! CLOCK_MONOTONIC timestamp in nanoseconds. */
+    uint64_t ts;
+    uint32_t nargs;
+    struct trace_arg args[TRACE_MAX_ARGS];
+};
+
+/**
+ * @brief Per thread trace ring.
+ */
+struct trace_ring
+{
+    /*! Written by the owning thread only. */
+    uint64_t head __attribute__((aligned(64)));
+    /*! Written by the drain thread only. */
+    uint64_t tail __attribute__((aligned(64)));
+    /*! Records lost because the ring was full. */
+    uint64_t dropped;
+    uint32_t mask;
+    struct trace_ring* next;
+    struct trace_rec recs[];
+};
+
+/*! Set while the rings are started. */
+extern int trace_active;
+/*! Ring of the calling thread, an always full ring until it registers one. */
+extern __thread struct trace_ring* trace_ring;
+
+/**
+ * @brief Allocate and register the ring of the calling thread.
+ *
+ * Every thread which traces calls it when it starts, after trace_start().
+ * Records of a thread without a ring of its own are dropped and reported
+ * by the drain thread.
+ *
+ * @return 0 on success or when the rings are not started, -1 otherwise.
+ */
+int
+trace_register();
+
+/**
+ * @brief Start the drain thread and switch tracepoints to the rings.
+ *
+ * @param [in] size  Records per thread ring, rounded up to a power of 2.
+ * @return 0 on success, -1 otherwise.
+ */
+int
+trace_start(uint32_t size);
+
+/**
+ * @brief Drain all rings, stop the drain thread and switch tracepoints
+ * back to direct logging.
+ */
+void
+trace_stop();
+
+/**
+ * @brief Format a record.
+ *
+ * @param [in] rec Trace record.
+ * @param [out] buf Output buffer.
+ * @param [in] len Size of the output buffer.
+ */
+void
+trace_format(const struct trace_rec* rec, char* buf, int len);
+
+static inline struct trace_rec*
+trace_reserve(const struct trace_fmt* fmt)
+{
+    struct trace_ring* ring = trace_ring;
+    struct trace_rec* rec;
+    struct timespec ts;
+
+    if (ring->head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) > ring->mask) {
+        __atomic_store_n(&ring->dropped, ring->dropped + 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    rec = &ring->recs[ring->head & ring->mask];
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    rec->fmt = fmt;
+    rec->ts = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    return rec;
+}
+
+static inline void
+trace_commit()
+{
+    __atomic_store_n(&trace_ring->head, trace_ring->head + 1, __ATOMIC_RELEASE);
+}
+
+static inline struct trace_arg
+trace_arg_int(int64_t v)
+{
+    return (struct trace_arg){ .type = TRACE_ARG_INT, .i = v };
+}
+
+static inline struct trace_arg
+trace_arg_double(double v)
+{
+    return (struct trace_arg){ .type = TRACE_ARG_DOUBLE, .d = v };
+}
+
+static inline struct trace_arg
+trace_arg_str(const char* v)
+{
+    return (struct trace_arg){ .type = TRACE_ARG_STR, .s = v };
+}
+
+#define TRACE_ARG(x)                                                                                                   \
+    _Generic((x), float                                                                                                \
+             : trace_arg_double, double                                                                                \
+             : trace_arg_double, char*                                                                                 \
+             : trace_arg_str, const char*                                                                              \
+             : trace_arg_str, default                                                                                  \
+             : trace_arg_int)(x)
+
+#define TRACE_STORE_0(r)
+#define TRACE_STORE_1(r, a) (r)->args[0] = TRACE_ARG(a)
+#define TRACE_STORE_2(r, a, ...) TRACE_STORE_1(r, a), (r)->args[1] = TRACE_ARG(__VA_ARGS__)
+#define TRACE_STORE_3(r, a, b, ...) TRACE_STORE_2(r, a, b), (r)->args[2] = TRACE_ARG(__VA_ARGS__)
+#define TRACE_STORE_4(r, a, b, c, ...) TRACE_STORE_3(r, a, b, c), (r)->args[3] = TRACE_ARG(__VA_ARGS__)
+#define TRACE_STORE_5(r, a, b, c, d, ...) TRACE_STORE_4(r, a, b, c, d), (r)->args[4] = TRACE_ARG(__VA_ARGS__)
+#define TRACE_STORE_6(r, a, b, c, d, e, ...) TRACE_STORE_5(r, a, b, c, d, e), (r)->args[5] = TRACE_ARG(__VA_ARGS__)
+
+#define TRACE_SELECT(_0, _1, _2, _3, _4, _5, _6, N, ...) N
+#define TRACE_NARGS(...) TRACE_SELECT(_0, ##__VA_ARGS__, 6, 5, 4, 3, 2, 1, 0)
+#define TRACE_STORE(r, ...)                                                                                            \
+    TRACE_SELECT(_0,                                                                                                   \
+                 ##__VA_ARGS__,                                                                                        \
+                 TRACE_STORE_6,                                                                                        \
+                 TRACE_STORE_5,                                                                                        \
+                 TRACE_STORE_4,                                                                                        \
+                 TRACE_STORE_3,                                                                                        \
+                 TRACE_STORE_2,                                                                                        \
+                 TRACE_STORE_1,                                                                                        \
+                 TRACE_STORE_0)                                                                                        \
+    (r, ##__VA_ARGS__)
+
+#define trace_log(lvl, lvl_name, fmt, ...)                                                                             \
+    do {                                                                                                               \
+        static const struct trace_fmt __tf = { .format = fmt, .name = lvl_name, .level = lvl };                        \
+        struct trace_rec* __tr;                                                                                        \
+        if (!logger_enabled(lvl)) {                                                                                    \
+        } else if (!trace_active) {                                                                                    \
+            logger(lvl, lvl_name, fmt, ##__VA_ARGS__);                                                                 \
+        } else if ((__tr = trace_reserve(&__tf))) {                                                                    \
+            __tr->nargs = TRACE_NARGS(__VA_ARGS__);                                                                    \
+            TRACE_STORE(__tr, ##__VA_ARGS__);                                                                          \
+            trace_commit();                                                                                            \
+        }                                                                                                              \
+    } while (0)
+
+#define trace_info(...) trace_log(LOG_INFO, "INFO", __VA_ARGS__)
+#define trace_debug(...) trace_log(LOG_DEBUG, "DEBUG", __VA_ARGS__)
+
+#endif /* __TRACE_H__ */
@@ -4,12 +4,17 @@
  * @note SPDX-License-Identifier: GPL-2.0+
  */
 
+#define LOG_SUBSYS LOG_SUBSYS_TSPROC
+
 #include <stdlib.h>
 #include <inttypes.h>
 
+#include "arena.h"
 #include "tsproc.h"
 #include "filter.h"
 #include "logger.h"
+#include "probes.h"
+#include "trace.h"
 
 static int
 weighting(struct tsproc* tsp)
@@ -30,7 +35,7 @@ tsproc_create(enum tsproc_mode mode, enum filter_type delay_filter, int filter_l
 {
     struct tsproc* tsp;
 
-    tsp = calloc(1, sizeof(*tsp));
+    tsp = arena_calloc(1, sizeof(*tsp));
     if (!tsp)
         return NULL;
 
@@ -42,13 +47,13 @@ tsproc_create(enum tsproc_mode mode, enum filter_type delay_filter, int filter_l
         tsp->mode = mode;
         break;
     default:
-        free(tsp);
+        arena_free(tsp);
         return NULL;
     }
 
     tsp->delay_filter = filter_create(delay_filter, filter_length);
     if (!tsp->delay_filter) {
-        free(tsp);
+        arena_free(tsp);
         return NULL;
     }
 
@@ -57,11 +62,56 @@ tsproc_create(enum tsproc_mode mode, enum filter_type delay_filter, int filter_l
     return tsp;
 }
 
+int
+tsproc_set_outlier_filter(struct tsproc* tsp, enum outlier_mode mode, int length, double threshold, int64_t min_mad)
+{
+    struct outlier *delay_outlier = NULL, *offset_outlier = NULL;
+
+    if (mode != OUTLIER_MODE_NONE) {
+        delay_outlier = outlier_create(mode, length, threshold, min_mad);
+        if (!delay_outlier)
+            return -1;
+        offset_outlier = outlier_create(mode, length, threshold, min_mad);
+        if (!offset_outlier) {
+            outlier_destroy(delay_outlier);
+            return -1;
+        }
+    }
+
+    if (tsp->delay_outlier)
+        outlier_destroy(tsp->delay_outlier);
+    if (tsp->offset_outlier)
+        outlier_destroy(tsp->offset_outlier);
+    tsp->delay_outlier = delay_outlier;
+    tsp->offset_outlier = offset_outlier;
+
+    return 0;
+}
+
+void
+tsproc_outlier_stats(struct tsproc* tsp, struct outlier_stats* delay, struct outlier_stats* offset)
+{
+    static const struct outlier_stats none;
+
+    if (delay)
+        *delay = none;
+    if (offset)
+        *offset = none;
+    if (delay && tsp->delay_outlier)
+        outlier_get_stats(tsp->delay_outlier, delay);
+    if (offset && tsp->offset_outlier)
+        outlier_get_stats(tsp->offset_outlier, offset);
+}
+
 void
 tsproc_destroy(struct tsproc* tsp)
 {
+    if (tsp->delay_outlier)
+        outlier_destroy(tsp->delay_outlier);
+    if (tsp->offset_outlier)
+        outlier_destroy(tsp->offset_outlier);
     filter_destroy(tsp->delay_filter);
-    free(tsp);
+    arena_free(tsp);
 }
 
 void
@@ -124,10 +174,19 @@ tsproc_update_delay(struct tsproc* tsp, tmv_t* delay)
         return -1;
 
     raw_delay = get_raw_delay(tsp);
+    tsp->raw_delay = raw_delay;
+
+    /* The delay filter takes no weights, so delay outliers are dropped. */
+    if (tsp->delay_outlier && outlier_sample(tsp->delay_outlier, raw_delay) < 1.0) {
+        PROBE3(delay_update, tmv_to_nanoseconds(raw_delay), tmv_to_nanoseconds(tsp->filtered_delay), 0);
+        return -1;
+    }
+
     tsp->filtered_delay = filter_sample(tsp->delay_filter, raw_delay);
     tsp->filtered_delay_valid = 1;
+    PROBE3(delay_update, tmv_to_nanoseconds(raw_delay), tmv_to_nanoseconds(tsp->filtered_delay), 1);
 
-    pr_debug("delay   filtered %10" PRId64 "   raw %10" PRId64,
+    trace_debug("delay   filtered %10" PRId64 "   raw %10" PRId64,
              tmv_to_nanoseconds(tsp->filtered_delay),
              tmv_to_nanoseconds(raw_delay));
 
@@ -153,6 +212,7 @@ int
 tsproc_update_offset(struct tsproc* tsp, tmv_t* offset, double* weight)
 {
     tmv_t delay = tmv_zero(), raw_delay = tmv_zero();
+    double outlier_weight = 1.0;
 
     if (tmv_is_zero(tsp->t1) || tmv_is_zero(tsp->t2))
         return -1;
@@ -184,6 +244,14 @@ tsproc_update_offset(struct tsproc* tsp, tmv_t* offset, double* weight)
     /* offset = t2 - t1 - delay */
     *offset = tmv_sub(tmv_sub(tsp->t2, tsp->t1), delay);
 
+    if (tsp->offset_outlier) {
+        outlier_weight = outlier_sample(tsp->offset_outlier, *offset);
+        if (outlier_weight == 0.0) {
+            PROBE4(offset_update, tmv_to_nanoseconds(*offset), tmv_to_nanoseconds(delay), 0, 0);
+            return -1;
+        }
+    }
+
     if (!weight)
         return 0;
 
@@ -194,9 +262,11 @@ tsproc_update_offset(struct tsproc* tsp, tmv_t* offset, double* weight)
     } else {
         *weight = 1.0;
     }
-    pr_debug("t1 = %+10" PRId64, tmv_to_nanoseconds(tsp->t1));
-    pr_debug("t2 = %+10" PRId64, tmv_to_nanoseconds(tsp->t2));
-    pr_debug("offset: t2 -t1 = %+10" PRId64, tmv_to_nanoseconds(*offset));
+    *weight *= outlier_weight;
+    PROBE4(offset_update, tmv_to_nanoseconds(*offset), tmv_to_nanoseconds(delay), (int64_t)(*weight * 1e6), 1);
+    trace_debug("t1 = %+10" PRId64, tmv_to_nanoseconds(tsp->t1));
+    trace_debug("t2 = %+10" PRId64, tmv_to_nanoseconds(tsp->t2));
+    trace_debug("offset: t2 -t1 = %+10" PRId64, tmv_to_nanoseconds(*offset));
     return 0;
 }
 
@@ -208,9 +278,15 @@ tsproc_reset(struct tsproc* tsp, int full)
     tsp->t3 = tmv_zero();
     tsp->t4 = tmv_zero();
 
+    /* Offsets before and after a step are not comparable. */
+    if (tsp->offset_outlier)
+        outlier_reset(tsp->offset_outlier);
+
     if (full) {
         tsp->clock_rate_ratio = 1.0;
         filter_reset(tsp->delay_filter);
         tsp->filtered_delay_valid = 0;
+        if (tsp->delay_outlier)
+            outlier_reset(tsp->delay_outlier);
     }
 }
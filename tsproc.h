@@ -8,6 +8,7 @@
 #define __TSPROC_H__
 
 #include "filter.h"
+#include "outlier.h"
 
 /** Opaque type */
 struct tsproc;
@@ -39,12 +40,19 @@ struct tsproc
     tmv_t t3;
     tmv_t t4;
 
+    /* Latest raw delay */
+    tmv_t raw_delay;
+
     /* Current filtered delay */
     tmv_t filtered_delay;
     int filtered_delay_valid;
 
     /* Delay filter */
     struct filter* delay_filter;
+
+    /* Outlier detectors, NULL when disabled */
+    struct outlier* delay_outlier;
+    struct outlier* offset_outlier;
 };
 
 /**
@@ -57,6 +65,32 @@ struct tsproc
 struct tsproc*
 tsproc_create(enum tsproc_mode mode, enum filter_type delay_filter, int filter_length);
 
+/**
+ * Enable outlier rejection of delay and offset measurements.
+ *
+ * Delay outliers are always dropped before they reach the delay filter.
+ * Offset outliers are dropped or down-weighted through the weight returned
+ * by @ref tsproc_update_offset(), depending on the mode.
+ *
+ * @param tsp        Pointer obtained via @ref tsproc_create().
+ * @param mode       Outlier handling mode.
+ * @param length     Length of the detector window.
+ * @param threshold  Rejection threshold in scaled MADs.
+ * @param min_mad    Lower bound of the MAD in nanoseconds.
+ * @return           0 on success, -1 on failure.
+ */
+int
+tsproc_set_outlier_filter(struct tsproc* tsp, enum outlier_mode mode, int length, double threshold, int64_t min_mad);
+
+/**
+ * Read the outlier detector counters.
+ * @param tsp     Pointer obtained via @ref tsproc_create().
+ * @param delay   Where to store the delay detector counters, may be NULL.
+ * @param offset  Where to store the offset detector counters, may be NULL.
+ */
+void
+tsproc_outlier_stats(struct tsproc* tsp, struct outlier_stats* delay, struct outlier_stats* offset);
+
 /**
  * Destroy a time stamp processor.
  * @param tsp       Pointer obtained via @ref tsproc_create().
@@ -103,7 +137,8 @@ tsproc_set_delay(struct tsproc* tsp, tmv_t delay);
  * Update delay in a time stamp processor using new measurements.
  * @param tsp    Pointer obtained via @ref tsproc_create().
  * @param delay  A pointer to store the new delay, may be NULL.
- * @return       0 on success, -1 when missing a measurement.
+ * @return       0 on success, -1 when missing a measurement or when the
+ *               measurement was rejected as an outlier.
  */
 int
 tsproc_update_delay(struct tsproc* tsp, tmv_t* delay);
@@ -113,7 +148,8 @@ tsproc_update_delay(struct tsproc* tsp, tmv_t* delay);
  * @param tsp    Pointer obtained via @ref tsproc_create().
  * @param offset A pointer to store the new offset.
  * @param weight A pointer to store the weight of the sample, may be NULL.
- * @return       0 on success, -1 when missing a measurement.
+ * @return       0 on success, -1 when missing a measurement or when the
+ *               measurement was rejected as an outlier.
  */
 int
 tsproc_update_offset(struct tsproc* tsp, tmv_t* offset, double* weight);
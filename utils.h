@@ -19,6 +19,19 @@
         (type*)((char*)__mptr - offsetof(type, member));                                                               \
     })
 
+/* Spin wait hint, yields the pipeline to the SMT sibling. */
+static inline void
+cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#else
+    __asm__ __volatile__("" ::: "memory");
+#endif
+}
+
 #define CLOCKFD 3
 #define FD_TO_CLOCKID(fd) ((~(clockid_t)(fd) << 3) | CLOCKFD)
 #define CLOCKID_TO_FD(clk) ((unsigned int)~((clk) >> 3))